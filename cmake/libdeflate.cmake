@@ -0,0 +1,26 @@
+# Add libdeflate library, used for whole buffer packets compression and decompression
+
+# We first try to find libdeflate in the system
+find_package(libdeflate CONFIG QUIET)
+
+# If not found, build it from sources
+if(NOT TARGET libdeflate::libdeflate_static AND NOT TARGET libdeflate::libdeflate_shared)
+    message(STATUS "Can't find libdeflate, downloading and building it from sources")
+
+    set(LIBDEFLATE_BUILD_STATIC_LIB ON CACHE BOOL "" FORCE)
+    set(LIBDEFLATE_BUILD_SHARED_LIB OFF CACHE BOOL "" FORCE)
+    set(LIBDEFLATE_BUILD_GZIP OFF CACHE BOOL "" FORCE)
+    set(LIBDEFLATE_BUILD_TESTS OFF CACHE BOOL "" FORCE)
+    # Only the zlib wrapper format is used by Minecraft
+    set(LIBDEFLATE_GZIP_SUPPORT OFF CACHE BOOL "" FORCE)
+
+    FetchContent_Declare(
+      libdeflate
+      GIT_REPOSITORY https://github.com/ebiggers/libdeflate.git
+      GIT_TAG v1.22
+      GIT_SHALLOW TRUE
+      GIT_PROGRESS TRUE
+    )
+
+    FetchContent_MakeAvailable(libdeflate)
+endif()
@@ -0,0 +1,23 @@
+# Add liburing library, used by asio io_uring backend
+
+find_package(PkgConfig QUIET)
+if(PkgConfig_FOUND)
+    pkg_check_modules(LIBURING QUIET IMPORTED_TARGET liburing)
+endif()
+
+if(TARGET PkgConfig::LIBURING)
+    add_library(liburing ALIAS PkgConfig::LIBURING)
+else()
+    find_path(LIBURING_INCLUDE_DIR liburing.h)
+    find_library(LIBURING_LIBRARY uring)
+
+    if(NOT LIBURING_INCLUDE_DIR OR NOT LIBURING_LIBRARY)
+        message(FATAL_ERROR "SNIFFCRAFT_WITH_IO_URING is set but liburing can't be found. Please install it (liburing-dev) or disable the option")
+    endif()
+
+    add_library(liburing UNKNOWN IMPORTED)
+    set_target_properties(liburing PROPERTIES
+        IMPORTED_LOCATION "${LIBURING_LIBRARY}"
+        INTERFACE_INCLUDE_DIRECTORIES "${LIBURING_INCLUDE_DIR}"
+    )
+endif()
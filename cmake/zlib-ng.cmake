@@ -0,0 +1,48 @@
+# Add zlib-ng library, built in zlib compatible mode so it can replace zlib without any code change
+
+# We first try to find zlib-ng in the system, as a zlib compatible install it can only be found as zlib.
+# Stock zlib must not be picked instead, so check the zlib-ng specific header before creating ZLIB::ZLIB
+if (NOT SNIFFCRAFT_FORCE_LOCAL_ZLIB)
+    find_path(ZLIB_NG_INCLUDE_DIR zlib_name_mangling.h)
+    if(ZLIB_NG_INCLUDE_DIR)
+        # Make FindZLIB use the zlib.h installed with zlib-ng
+        set(ZLIB_INCLUDE_DIR "${ZLIB_NG_INCLUDE_DIR}" CACHE PATH "" FORCE)
+        find_package(ZLIB QUIET)
+    else()
+        message(STATUS "zlib found in the system (if any) is not zlib-ng")
+    endif()
+endif(NOT SNIFFCRAFT_FORCE_LOCAL_ZLIB)
+
+# If not found, build from sources
+if(NOT TARGET ZLIB::ZLIB)
+    message(STATUS "Can't find zlib-ng, downloading and building it from sources")
+
+    set(ZLIB_COMPAT ON CACHE BOOL "" FORCE)
+    set(ZLIB_ENABLE_TESTS OFF CACHE BOOL "" FORCE)
+    set(ZLIBNG_ENABLE_TESTS OFF CACHE BOOL "" FORCE)
+    set(WITH_GTEST OFF CACHE BOOL "" FORCE)
+    set(WITH_GZFILEOP OFF CACHE BOOL "" FORCE)
+    set(SKIP_INSTALL_ALL ON CACHE BOOL "" FORCE)
+
+    # Don't build zlib-ng as a shared library even if BUILD_SHARED_LIBS is set for the whole project
+    set(_BUILD_SHARED_LIBS ${BUILD_SHARED_LIBS})
+    set(BUILD_SHARED_LIBS OFF)
+
+    FetchContent_Declare(
+      zlib-ng
+      GIT_REPOSITORY https://github.com/zlib-ng/zlib-ng.git
+      GIT_TAG 2.2.2
+      GIT_SHALLOW TRUE
+      GIT_PROGRESS TRUE
+    )
+
+    FetchContent_MakeAvailable(zlib-ng)
+
+    set(BUILD_SHARED_LIBS ${_BUILD_SHARED_LIBS})
+    unset(_BUILD_SHARED_LIBS)
+
+    # We link to ZLIB::ZLIB so we need an alias if zlib-ng doesn't already provide one
+    if(NOT TARGET ZLIB::ZLIB)
+        add_library(ZLIB::ZLIB ALIAS zlib)
+    endif()
+endif()
@@ -0,0 +1,108 @@
+#include "sniffcraft/MinecraftEncryptionDataProcessor.hpp"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+double ElapsedSeconds(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief Encrypt or decrypt data in place with OpenSSL AES-128-CFB8, one byte per AES block encryption
+void EVPCFB8(const std::vector<unsigned char>& key, const bool encrypt, std::vector<unsigned char>& data, const size_t read_size)
+{
+    EVP_CIPHER_CTX* context = EVP_CIPHER_CTX_new();
+    if (context == nullptr || EVP_CipherInit_ex(context, EVP_aes_128_cfb8(), nullptr, key.data(), key.data(), encrypt ? 1 : 0) != 1)
+    {
+        throw std::runtime_error("Error initializing AES-128-CFB8 context");
+    }
+    for (size_t position = 0; position < data.size(); position += read_size)
+    {
+        int out_length = 0;
+        EVP_CipherUpdate(context, data.data() + position, &out_length, data.data() + position, static_cast<int>(std::min(read_size, data.size() - position)));
+    }
+    EVP_CIPHER_CTX_free(context);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--help")
+    {
+        std::cout << "Usage: " << argv[0] << " [size_MiB=64] [iterations=5] [read_size=16384]\n"
+            << "Decrypt random data with OpenSSL byte-wise AES-128-CFB8 and with the batched decryption\n"
+            << "of MinecraftEncryptionDataProcessor, fed by chunks of read_size bytes like socket reads" << std::endl;
+        return 0;
+    }
+
+    const size_t size = (argc > 1 ? std::stoul(argv[1]) : 64) * 1024 * 1024;
+    const int iterations = argc > 2 ? std::stoi(argv[2]) : 5;
+    const size_t read_size = argc > 3 ? std::stoul(argv[3]) : 16384;
+
+    std::cout << "OpenSSL " << OpenSSL_version(OPENSSL_VERSION) << ", batches of " << DECRYPTION_BATCH_SIZE << " bytes" << std::endl;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> distribution(0, 255);
+    std::vector<unsigned char> key(16);
+    for (unsigned char& k : key)
+    {
+        k = static_cast<unsigned char>(distribution(rng));
+    }
+    std::vector<unsigned char> plaintext(size);
+    for (unsigned char& c : plaintext)
+    {
+        c = static_cast<unsigned char>(distribution(rng));
+    }
+    std::vector<unsigned char> ciphertext = plaintext;
+    EVPCFB8(key, true, ciphertext, ciphertext.size());
+
+    // OpenSSL CFB8, what the proxy did before batching
+    std::vector<unsigned char> data;
+    double best_seconds = 0.0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        data = ciphertext;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        EVPCFB8(key, false, data, read_size);
+        const double seconds = ElapsedSeconds(start);
+        best_seconds = i == 0 ? seconds : std::min(best_seconds, seconds);
+    }
+    if (data != plaintext)
+    {
+        std::cerr << "OpenSSL CFB8 decryption mismatch" << std::endl;
+        return 1;
+    }
+    std::cout << "EVP CFB8: " << best_seconds * 1000.0 << " ms, "
+        << static_cast<double>(size) / best_seconds / (1024.0 * 1024.0) << " MiB/s" << std::endl;
+
+    // Batched keystream computation
+    best_seconds = 0.0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        data = ciphertext;
+        MinecraftEncryptionDataProcessor processor(key);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t position = 0; position < data.size(); position += read_size)
+        {
+            processor.ProcessIncomingData(data.data() + position, std::min(read_size, data.size() - position));
+        }
+        const double seconds = ElapsedSeconds(start);
+        best_seconds = i == 0 ? seconds : std::min(best_seconds, seconds);
+    }
+    if (data != plaintext)
+    {
+        std::cerr << "Batched CFB8 decryption mismatch" << std::endl;
+        return 1;
+    }
+    std::cout << "Batched CFB8: " << best_seconds * 1000.0 << " ms, "
+        << static_cast<double>(size) / best_seconds / (1024.0 * 1024.0) << " MiB/s" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "sniffcraft/Compression.hpp"
+#include "sniffcraft/Framing.hpp"
+
+#include <zlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// @brief A packet data as it would be sent on the wire
+struct WirePacket
+{
+    std::vector<unsigned char> compressed;
+    size_t decompressed_size;
+};
+
+/// @brief Skip a VarLong without decoding it
+/// @return Number of bytes of the VarLong, 0 if incomplete
+size_t SkipVarLong(const unsigned char* const data, const size_t length)
+{
+    for (size_t i = 0; i < length && i < 10; ++i)
+    {
+        if ((data[i] & 0x80) == 0)
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Load the data of all the packets stored in a .scbin capture
+/// @param path Path of the capture file
+/// @return The uncompressed data of each packet record
+std::vector<std::vector<unsigned char>> LoadCapture(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Can't open " + path);
+    }
+    const std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const unsigned char* ptr = data.data();
+    size_t length = data.size();
+
+    // Header, protocol version and start time
+    int protocol_version = 0;
+    size_t read = ReadVarIntNoThrow(ptr, length, protocol_version);
+    ptr += read;
+    length -= read;
+    read = SkipVarLong(ptr, length);
+    if (read == 0)
+    {
+        throw std::runtime_error("Invalid capture header");
+    }
+    ptr += read;
+    length -= read;
+
+    std::vector<std::vector<unsigned char>> packets;
+    while (length > 0)
+    {
+        const bool compressed = ptr[0] != 0;
+        int record_size = 0;
+        read = ReadVarIntNoThrow(ptr + 1, length - 1, record_size);
+        if (read == 0 || record_size < 0 || static_cast<size_t>(record_size) > length - 1 - read)
+        {
+            std::cerr << "Truncated record, stopping loading here" << std::endl;
+            break;
+        }
+        ptr += 1 + read;
+        length -= 1 + read;
+
+        packets.push_back(compressed ? Decompress(ptr, record_size) : std::vector<unsigned char>(ptr, ptr + record_size));
+        ptr += record_size;
+        length -= record_size;
+    }
+
+    return packets;
+}
+
+double ElapsedSeconds(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " capture.scbin [iterations=20] [level=1] [threshold=256]\n"
+            << "Compress the packets of a sniffcraft capture as a server would, then measure the\n"
+            << "throughput of the selected compression backend on them. Decompression is measured\n"
+            << "with the proxy reused stream, with a new stream per packet and for the packet id only" << std::endl;
+        return 0;
+    }
+
+    const std::string path = argv[1];
+    const int iterations = argc > 2 ? std::stoi(argv[2]) : 20;
+    const int level = argc > 3 ? std::stoi(argv[3]) : 1;
+    const size_t threshold = argc > 4 ? std::stoul(argv[4]) : 256;
+
+#ifdef USE_LIBDEFLATE
+    std::cout << "Backend: libdeflate (zlib " << zlibVersion() << " for streams)" << std::endl;
+#else
+    std::cout << "Backend: zlib " << zlibVersion() << std::endl;
+#endif
+
+    const std::vector<std::vector<unsigned char>> packets = LoadCapture(path);
+
+    // Only the packets above the threshold are compressed on the wire
+    Compressor compressor(level);
+    std::vector<WirePacket> wire_packets;
+    size_t total_size = 0;
+    size_t total_compressed_size = 0;
+    for (const std::vector<unsigned char>& packet : packets)
+    {
+        if (packet.size() < threshold)
+        {
+            continue;
+        }
+        const std::vector<unsigned char>& compressed = compressor.Compress(packet.data(), packet.size());
+        wire_packets.push_back({ compressed, packet.size() });
+        total_size += packet.size();
+        total_compressed_size += compressed.size();
+    }
+
+    std::cout << packets.size() << " packets loaded, " << wire_packets.size() << " above the threshold: "
+        << total_size << " bytes, " << total_compressed_size << " compressed at level " << level << std::endl;
+    if (wire_packets.empty())
+    {
+        return 0;
+    }
+
+    const double num_decompressed = static_cast<double>(wire_packets.size()) * iterations;
+
+    // Inflate, what the proxy does for each compressed packet it parses
+    Decompressor decompressor;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const WirePacket& packet : wire_packets)
+        {
+            decompressor.Decompress(packet.compressed.data(), packet.compressed.size(), packet.decompressed_size);
+        }
+    }
+    double seconds = ElapsedSeconds(start);
+    std::cout << "Decompress: " << seconds * 1000.0 << " ms, "
+        << static_cast<double>(total_size) * iterations / seconds / (1024.0 * 1024.0) << " MiB/s of output, "
+        << seconds * 1e9 / num_decompressed << " ns/packet" << std::endl;
+
+    // Same packets with a new inflate stream and output vector for each of them
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const WirePacket& packet : wire_packets)
+        {
+            Decompress(packet.compressed.data(), packet.compressed.size());
+        }
+    }
+    seconds = ElapsedSeconds(start);
+    std::cout << "Decompress (new stream per packet): " << seconds * 1000.0 << " ms, "
+        << static_cast<double>(total_size) * iterations / seconds / (1024.0 * 1024.0) << " MiB/s of output, "
+        << seconds * 1e9 / num_decompressed << " ns/packet" << std::endl;
+
+    // Only the first bytes, what the proxy does to get the id of the packets it may skip
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const WirePacket& packet : wire_packets)
+        {
+            decompressor.DecompressHead(packet.compressed.data(), packet.compressed.size(), 5);
+        }
+    }
+    seconds = ElapsedSeconds(start);
+    std::cout << "Decompress head: " << seconds * 1000.0 << " ms, "
+        << seconds * 1e9 / num_decompressed << " ns/packet" << std::endl;
+
+    // Deflate, what the proxy does for each packet it sends
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (const std::vector<unsigned char>& packet : packets)
+        {
+            if (packet.size() >= threshold)
+            {
+                compressor.Compress(packet.data(), packet.size());
+            }
+        }
+    }
+    seconds = ElapsedSeconds(start);
+    std::cout << "Compress: " << seconds * 1000.0 << " ms, "
+        << static_cast<double>(total_size) * iterations / seconds / (1024.0 * 1024.0) << " MiB/s of input" << std::endl;
+
+    return 0;
+}
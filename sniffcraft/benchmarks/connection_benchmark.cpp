@@ -0,0 +1,226 @@
+#include "sniffcraft/Connection.hpp"
+#include "sniffcraft/SpliceForwarder.hpp"
+
+#include <asio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using asio::ip::tcp;
+
+/// @brief Size of each blocking write of the sending side
+constexpr size_t SEND_CHUNK_SIZE = 1024 * 1024;
+
+struct ReadResult
+{
+    double seconds;
+    /// @brief Number of times the data callback was called, once per completed socket read
+    size_t callbacks;
+};
+
+double ElapsedSeconds(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief Send data over loopback from a plain socket to a Connection, consuming them as soon as they are received
+/// @param size Number of bytes to send
+/// @param max_read_buffer_size Max size of a single read of the Connection
+/// @return Time until everything has been received and number of reads it took
+ReadResult MeasureReads(const size_t size, const size_t max_read_buffer_size)
+{
+    asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    // Locked by the connection handlers, as a proxy would be
+    const std::shared_ptr<int> owner = std::make_shared<int>(0);
+    Connection connection(asio::make_strand(io_context));
+    tcp::socket sender(io_context);
+    sender.connect(acceptor.local_endpoint());
+    acceptor.accept(connection.GetSocket());
+
+    size_t callbacks = 0;
+    size_t received = 0;
+    connection.SetOwner(owner);
+    connection.SetMaxReadBufferSize(max_read_buffer_size);
+    connection.SetCallback([&]()
+        {
+            callbacks += 1;
+            ByteRingBuffer& received_data = connection.GetReceivedData();
+            const size_t readable = received_data.ReadableSize();
+            received_data.Consume(readable);
+            connection.NotifyDataConsumed();
+            received += readable;
+            if (received >= size)
+            {
+                io_context.stop();
+            }
+        });
+
+    const std::vector<unsigned char> chunk(SEND_CHUNK_SIZE, 42);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    connection.StartListeningAndWriting();
+    std::thread writer([&]()
+        {
+            for (size_t sent = 0; sent < size; sent += SEND_CHUNK_SIZE)
+            {
+                asio::write(sender, asio::buffer(chunk.data(), std::min(SEND_CHUNK_SIZE, size - sent)));
+            }
+        });
+    io_context.run();
+    const double seconds = ElapsedSeconds(start);
+    writer.join();
+
+    return { seconds, callbacks };
+}
+
+void PrintReadResult(const std::string& name, const size_t size, const ReadResult& result)
+{
+    const double mib = static_cast<double>(size) / (1024.0 * 1024.0);
+    std::cout << name << ": " << mib / result.seconds << " MiB/s, "
+        << static_cast<double>(result.callbacks) / mib << " callbacks/MiB, "
+        << static_cast<double>(size) / static_cast<double>(result.callbacks) << " bytes/read" << std::endl;
+}
+
+/// @brief Send data over loopback from a plain socket to another one, through two Connections forwarding them as a proxy does
+/// @param size Number of bytes to send
+/// @param splice If true, forward with a SpliceForwarder, as in raw forwarding mode, else share the received bytes with the other Connection
+/// @return Time until everything has been received on the other side, or nothing if splice forwarding is not available
+std::optional<double> MeasureForwarding(const size_t size, const bool splice)
+{
+    asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    const std::shared_ptr<int> owner = std::make_shared<int>(0);
+    // Same strand for both directions, as the proxy sockets
+    const asio::strand<asio::io_context::executor_type> strand = asio::make_strand(io_context);
+    Connection client_connection(strand);
+    Connection server_connection(strand);
+    tcp::socket client(io_context);
+    tcp::socket server(io_context);
+    client.connect(acceptor.local_endpoint());
+    acceptor.accept(client_connection.GetSocket());
+    server_connection.GetSocket().connect(acceptor.local_endpoint());
+    acceptor.accept(server);
+
+    client_connection.SetOwner(owner);
+    server_connection.SetOwner(owner);
+
+    std::unique_ptr<SpliceForwarder> forwarder;
+    std::function<void()> forward;
+    if (splice)
+    {
+        forwarder = std::make_unique<SpliceForwarder>(client_connection, server_connection, owner, []() {});
+        const std::optional<std::string> error = forwarder->Prepare();
+        if (error.has_value())
+        {
+            std::cerr << "Splice forwarding not available: " << error.value() << std::endl;
+            return std::nullopt;
+        }
+    }
+    else
+    {
+        // Same as BaseProxy::ProcessData, without copying the received bytes
+        forward = [&]()
+            {
+                ByteRingBuffer& received_data = client_connection.GetReceivedData();
+                size_t contiguous_size = 0;
+                while (!server_connection.IsWriteQueueFull())
+                {
+                    const std::vector<unsigned char>::const_iterator data = received_data.Front(contiguous_size);
+                    if (contiguous_size == 0)
+                    {
+                        break;
+                    }
+                    server_connection.WriteData(received_data.Share(&(*data), contiguous_size));
+                    received_data.Consume(contiguous_size);
+                    client_connection.NotifyDataConsumed();
+                }
+            };
+        client_connection.SetCallback(forward);
+        server_connection.SetWriteDrainedCallback(forward);
+    }
+
+    const std::vector<unsigned char> chunk(SEND_CHUNK_SIZE, 42);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (splice)
+    {
+        forwarder->Start();
+    }
+    else
+    {
+        client_connection.StartListeningAndWriting();
+    }
+    std::thread writer([&]()
+        {
+            for (size_t sent = 0; sent < size; sent += SEND_CHUNK_SIZE)
+            {
+                asio::write(client, asio::buffer(chunk.data(), std::min(SEND_CHUNK_SIZE, size - sent)));
+            }
+        });
+    std::thread reader([&]()
+        {
+            std::vector<unsigned char> buffer(SEND_CHUNK_SIZE);
+            size_t received = 0;
+            asio::error_code ec;
+            while (received < size && !ec)
+            {
+                received += server.read_some(asio::buffer(buffer), ec);
+            }
+            io_context.stop();
+        });
+    io_context.run();
+    const double seconds = ElapsedSeconds(start);
+    writer.join();
+    reader.join();
+
+    return seconds;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--help")
+    {
+        std::cout << "Usage: " << argv[0] << " [size_MiB=256]\n"
+            << "Send data through loopback to a Connection, with reads limited to MIN_READ_BUFFER_SIZE\n"
+            << "(the previous fixed read buffer) and with the adaptive read size. Each callback is one\n"
+            << "completed socket read, run with strace -c -f for the exact number of syscalls.\n"
+            << "Then forward data between two Connections as in raw forwarding mode, through the\n"
+            << "received data ring buffer and with splice when available" << std::endl;
+        return 0;
+    }
+
+    const size_t size = (argc > 1 ? std::stoul(argv[1]) : 256) * 1024 * 1024;
+
+    // Build with SNIFFCRAFT_WITH_IO_URING on and off to compare both backends
+#if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+    std::cout << "Network backend: io_uring" << std::endl;
+#elif defined(ASIO_HAS_EPOLL)
+    std::cout << "Network backend: epoll" << std::endl;
+#else
+    std::cout << "Network backend: asio default" << std::endl;
+#endif
+
+    PrintReadResult("Fixed " + std::to_string(MIN_READ_BUFFER_SIZE) + " bytes reads", size, MeasureReads(size, MIN_READ_BUFFER_SIZE));
+    PrintReadResult("Adaptive reads up to " + std::to_string(DEFAULT_MAX_READ_BUFFER_SIZE) + " bytes", size, MeasureReads(size, DEFAULT_MAX_READ_BUFFER_SIZE));
+
+    // Raw forwarding, with and without splice
+    const double mib = static_cast<double>(size) / (1024.0 * 1024.0);
+    const std::optional<double> shared_seconds = MeasureForwarding(size, false);
+    std::cout << "Forwarding through the ring buffer: " << mib / shared_seconds.value() << " MiB/s" << std::endl;
+    if (SpliceForwarder::IsSupported())
+    {
+        const std::optional<double> splice_seconds = MeasureForwarding(size, true);
+        if (splice_seconds.has_value())
+        {
+            std::cout << "Forwarding with splice: " << mib / splice_seconds.value() << " MiB/s" << std::endl;
+        }
+    }
+
+    return 0;
+}
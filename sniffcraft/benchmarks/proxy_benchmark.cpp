@@ -0,0 +1,430 @@
+#include "sniffcraft/BaseProxy.hpp"
+#include "sniffcraft/Framing.hpp"
+
+#include <asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using asio::ip::tcp;
+
+#ifndef PROTOCOL_VERSION
+#define PROTOCOL_VERSION 0
+#endif
+
+/// @brief Ids of the packets used by the benchmark, all in status state, the same in all versions
+constexpr int STATUS_REQUEST_ID = 0x00;
+constexpr int STATUS_RESPONSE_ID = 0x00;
+constexpr int PING_REQUEST_ID = 0x01;
+constexpr int PONG_RESPONSE_ID = 0x01;
+
+/// @brief Size of the status responses the server floods the client with in mixed mode
+constexpr size_t LOAD_PACKET_SIZE = 16 * 1024;
+/// @brief Time between two pings in mixed mode, they are not waiting for a pong
+constexpr std::chrono::microseconds LOADED_PING_INTERVAL(500);
+
+void WriteVarInt(std::vector<unsigned char>& output, const int value)
+{
+    unsigned int remaining = static_cast<unsigned int>(value);
+    do
+    {
+        unsigned char byte = remaining & 0x7F;
+        remaining >>= 7;
+        if (remaining != 0)
+        {
+            byte |= 0x80;
+        }
+        output.push_back(byte);
+    } while (remaining != 0);
+}
+
+void WriteString(std::vector<unsigned char>& output, const std::string& value)
+{
+    WriteVarInt(output, static_cast<int>(value.size()));
+    output.insert(output.end(), value.begin(), value.end());
+}
+
+void WriteLong(std::vector<unsigned char>& output, const long long value)
+{
+    for (int i = 7; i >= 0; --i)
+    {
+        output.push_back(static_cast<unsigned char>((static_cast<unsigned long long>(value) >> (8 * i)) & 0xFF));
+    }
+}
+
+long long ReadLong(const unsigned char* const data)
+{
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        value = (value << 8) | data[i];
+    }
+    return static_cast<long long>(value);
+}
+
+/// @brief Build an uncompressed packet, with its length and id
+std::vector<unsigned char> MakePacket(const int id, const std::vector<unsigned char>& payload)
+{
+    std::vector<unsigned char> packet;
+    WriteVarInt(packet, static_cast<int>(VarIntSize(id) + payload.size()));
+    WriteVarInt(packet, id);
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    return packet;
+}
+
+long long NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// @brief Read uncompressed packets one by one from a blocking socket
+class PacketReader
+{
+public:
+    PacketReader(tcp::socket& socket) : socket(socket), buffer(64 * 1024), start(0), end(0)
+    {
+
+    }
+
+    /// @brief Wait for the next packet
+    /// @param id Id of the packet
+    /// @param payload Pointer to the packet data after the id, valid until the next call
+    /// @param payload_size Size of the packet data after the id
+    /// @return False if the socket has been closed
+    bool Next(int& id, const unsigned char*& payload, size_t& payload_size)
+    {
+        while (true)
+        {
+            int packet_size = 0;
+            const size_t length_size = ReadVarIntNoThrow(buffer.data() + start, end - start, packet_size);
+            if (length_size > 0 && end - start - length_size >= static_cast<size_t>(packet_size))
+            {
+                const unsigned char* const packet = buffer.data() + start + length_size;
+                const size_t id_size = ReadVarIntNoThrow(packet, packet_size, id);
+                payload = packet + id_size;
+                payload_size = packet_size - id_size;
+                start += length_size + packet_size;
+                return true;
+            }
+
+            // Move the partial packet at the beginning and make room for the rest
+            std::copy(buffer.begin() + start, buffer.begin() + end, buffer.begin());
+            end -= start;
+            start = 0;
+            if (length_size > 0 && length_size + packet_size > buffer.size())
+            {
+                buffer.resize(length_size + packet_size);
+            }
+            asio::error_code ec;
+            end += socket.read_some(asio::buffer(buffer.data() + end, buffer.size() - end), ec);
+            if (ec)
+            {
+                return false;
+            }
+        }
+    }
+
+private:
+    tcp::socket& socket;
+    std::vector<unsigned char> buffer;
+    size_t start;
+    size_t end;
+};
+
+/// @brief Both ends of a connection going through the benchmarked proxy
+struct ProxiedConnection
+{
+    ProxiedConnection(asio::io_context& io_context) : client(io_context), server(io_context)
+    {
+
+    }
+
+    /// @brief Our client, connected to the proxy
+    tcp::socket client;
+    /// @brief Our server, the proxy is connected to it
+    tcp::socket server;
+};
+
+/// @brief Send the handshake and get the status response, as a client pinging a server would
+/// @param connection Connection to use
+/// @param server_reader Reader of the server side
+/// @param client_reader Reader of the client side
+void ExchangeStatus(ProxiedConnection& connection, PacketReader& server_reader, PacketReader& client_reader)
+{
+    std::vector<unsigned char> handshake;
+    WriteVarInt(handshake, PROTOCOL_VERSION);
+    WriteString(handshake, "127.0.0.1");
+    handshake.push_back(0);
+    handshake.push_back(0);
+    WriteVarInt(handshake, 1); // Status intent
+    asio::write(connection.client, asio::buffer(MakePacket(0x00, handshake)));
+    asio::write(connection.client, asio::buffer(MakePacket(STATUS_REQUEST_ID, {})));
+
+    int id = 0;
+    const unsigned char* payload = nullptr;
+    size_t payload_size = 0;
+    // Handshake sent by the proxy, then status request
+    if (!server_reader.Next(id, payload, payload_size) || !server_reader.Next(id, payload, payload_size) || id != STATUS_REQUEST_ID)
+    {
+        throw std::runtime_error("Status request not received by the server");
+    }
+
+    std::vector<unsigned char> status;
+    WriteString(status, "{\"version\":{\"name\":\"proxy_benchmark\",\"protocol\":" + std::to_string(PROTOCOL_VERSION) + "},\"description\":{\"text\":\"\"}}");
+    asio::write(connection.server, asio::buffer(MakePacket(STATUS_RESPONSE_ID, status)));
+    if (!client_reader.Next(id, payload, payload_size) || id != STATUS_RESPONSE_ID)
+    {
+        throw std::runtime_error("Status response not received by the client");
+    }
+}
+
+/// @brief Print the average, median, 99th percentile and max of some durations
+void PrintLatencies(const std::string& name, std::vector<long long>& nanoseconds)
+{
+    if (nanoseconds.empty())
+    {
+        std::cout << name << ": no sample" << std::endl;
+        return;
+    }
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    long double sum = 0.0;
+    for (const long long n : nanoseconds)
+    {
+        sum += n;
+    }
+    std::cout << name << " (us): avg " << static_cast<double>(sum / nanoseconds.size()) / 1000.0
+        << ", p50 " << nanoseconds[nanoseconds.size() / 2] / 1000.0
+        << ", p99 " << nanoseconds[nanoseconds.size() * 99 / 100] / 1000.0
+        << ", max " << nanoseconds.back() / 1000.0 << std::endl;
+}
+
+/// @brief Send ping requests one at a time, the server answers each of them with a pong
+/// @param connection Connection to use
+/// @param samples Number of pings
+void MeasureLatency(ProxiedConnection& connection, const int samples)
+{
+    PacketReader server_reader(connection.server);
+    PacketReader client_reader(connection.client);
+    ExchangeStatus(connection, server_reader, client_reader);
+
+    std::vector<long long> serverbound;
+    std::vector<long long> round_trip;
+    serverbound.reserve(samples);
+    round_trip.reserve(samples);
+
+    std::thread server_thread([&]()
+        {
+            int id = 0;
+            const unsigned char* payload = nullptr;
+            size_t payload_size = 0;
+            for (int i = 0; i < samples && server_reader.Next(id, payload, payload_size); ++i)
+            {
+                if (id != PING_REQUEST_ID || payload_size != 8)
+                {
+                    continue;
+                }
+                serverbound.push_back(NowNanoseconds() - ReadLong(payload));
+                // Send the same timestamp back
+                asio::write(connection.server, asio::buffer(MakePacket(PONG_RESPONSE_ID, std::vector<unsigned char>(payload, payload + 8))));
+            }
+        });
+
+    int id = 0;
+    const unsigned char* payload = nullptr;
+    size_t payload_size = 0;
+    for (int i = 0; i < samples; ++i)
+    {
+        std::vector<unsigned char> timestamp;
+        WriteLong(timestamp, NowNanoseconds());
+        asio::write(connection.client, asio::buffer(MakePacket(PING_REQUEST_ID, timestamp)));
+        if (!client_reader.Next(id, payload, payload_size))
+        {
+            std::cerr << "Connection closed after " << i << " pings" << std::endl;
+            break;
+        }
+        if (id == PONG_RESPONSE_ID && payload_size == 8)
+        {
+            round_trip.push_back(NowNanoseconds() - ReadLong(payload));
+        }
+    }
+    asio::error_code ec;
+    connection.server.shutdown(tcp::socket::shutdown_both, ec);
+    server_thread.join();
+
+    PrintLatencies("Serverbound", serverbound);
+    PrintLatencies("Round trip", round_trip);
+}
+
+/// @brief Send ping requests at a fixed interval while the server floods the client with status responses
+/// @param connection Connection to use
+/// @param samples Number of pings
+void MeasureLatencyUnderLoad(ProxiedConnection& connection, const int samples)
+{
+    PacketReader server_reader(connection.server);
+    PacketReader client_reader(connection.client);
+    ExchangeStatus(connection, server_reader, client_reader);
+
+    std::vector<long long> serverbound;
+    serverbound.reserve(samples);
+    std::thread server_thread([&]()
+        {
+            int id = 0;
+            const unsigned char* payload = nullptr;
+            size_t payload_size = 0;
+            while (static_cast<int>(serverbound.size()) < samples && server_reader.Next(id, payload, payload_size))
+            {
+                if (id == PING_REQUEST_ID && payload_size == 8)
+                {
+                    serverbound.push_back(NowNanoseconds() - ReadLong(payload));
+                }
+            }
+        });
+
+    // Clientbound load, as fast as the proxy can forward it
+    std::vector<unsigned char> status;
+    WriteString(status, "{\"description\":{\"text\":\"" + std::string(LOAD_PACKET_SIZE, 'x') + "\"}}");
+    const std::vector<unsigned char> load_packet = MakePacket(STATUS_RESPONSE_ID, status);
+    std::vector<unsigned char> load;
+    for (int i = 0; i < 16; ++i)
+    {
+        load.insert(load.end(), load_packet.begin(), load_packet.end());
+    }
+    std::atomic<bool> loading = true;
+    std::thread load_thread([&]()
+        {
+            asio::error_code ec;
+            while (loading && !ec)
+            {
+                asio::write(connection.server, asio::buffer(load), ec);
+            }
+        });
+    size_t clientbound_bytes = 0;
+    std::thread drain_thread([&]()
+        {
+            std::vector<unsigned char> buffer(256 * 1024);
+            asio::error_code ec;
+            while (!ec)
+            {
+                clientbound_bytes += connection.client.read_some(asio::buffer(buffer), ec);
+            }
+        });
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; ++i)
+    {
+        std::vector<unsigned char> timestamp;
+        WriteLong(timestamp, NowNanoseconds());
+        asio::error_code ec;
+        asio::write(connection.client, asio::buffer(MakePacket(PING_REQUEST_ID, timestamp)), ec);
+        if (ec)
+        {
+            std::cerr << "Connection closed after " << i << " pings" << std::endl;
+            break;
+        }
+        std::this_thread::sleep_for(LOADED_PING_INTERVAL);
+    }
+    server_thread.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    loading = false;
+    load_thread.join();
+    // Unblock the drain thread, the proxy is only closed at the end
+    asio::error_code ec;
+    connection.client.shutdown(tcp::socket::shutdown_both, ec);
+    drain_thread.join();
+
+    std::cout << "Clientbound load: " << static_cast<double>(clientbound_bytes) / seconds / (1024.0 * 1024.0) << " MiB/s" << std::endl;
+    PrintLatencies("Serverbound under load", serverbound);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || std::string(argv[1]) == "--help")
+    {
+        std::cout << "Usage: " << argv[0] << " latency|mixed [samples=10000] [network_threads=2] [proxy_port server_port]\n"
+            << "Act as both a client and a server exchanging status packets through a proxy.\n"
+            << "latency: send pings one at a time, and measure the serverbound and round trip times\n"
+            << "mixed: flood the client with status responses, and measure the serverbound time of pings\n"
+            << "sent at a fixed interval, which should not wait behind the clientbound traffic\n"
+            << "Without ports, the data go through an in-process BaseProxy. With ports, the client\n"
+            << "connects to a running sniffcraft on proxy_port, which must be configured to connect\n"
+            << "to 127.0.0.1:server_port, for example to compare its ForwardFirst mode on and off" << std::endl;
+        return 0;
+    }
+
+    const std::string mode = argv[1];
+    const int samples = argc > 2 ? std::stoi(argv[2]) : 10000;
+    const unsigned int network_threads = argc > 3 ? std::stoul(argv[3]) : 2;
+    const bool external_proxy = argc > 5;
+
+    asio::io_context io_context;
+    tcp::acceptor server_acceptor(io_context, tcp::endpoint(asio::ip::make_address("127.0.0.1"), external_proxy ? static_cast<unsigned short>(std::stoul(argv[5])) : 0));
+    ProxiedConnection connection(io_context);
+
+    // Proxy running in this process, on its own threads
+    asio::io_context proxy_context;
+    asio::executor_work_guard<asio::io_context::executor_type> work_guard = asio::make_work_guard(proxy_context);
+    std::vector<std::thread> proxy_threads;
+    std::shared_ptr<BaseProxy> proxy;
+
+    if (external_proxy)
+    {
+        connection.client.connect(tcp::endpoint(asio::ip::make_address("127.0.0.1"), static_cast<unsigned short>(std::stoul(argv[4]))));
+    }
+    else
+    {
+        tcp::acceptor proxy_acceptor(io_context, tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+        proxy = std::make_shared<BaseProxy>(proxy_context);
+        connection.client.connect(proxy_acceptor.local_endpoint());
+        proxy_acceptor.accept(proxy->ClientSocket());
+        proxy->Start("127.0.0.1", server_acceptor.local_endpoint().port(), [](const std::optional<std::string>& error)
+            {
+                if (error.has_value())
+                {
+                    std::cerr << "Error starting the proxy: " << error.value() << std::endl;
+                }
+            });
+        for (unsigned int i = 0; i < std::max(network_threads, 1u); ++i)
+        {
+            proxy_threads.emplace_back([&proxy_context]() { proxy_context.run(); });
+        }
+    }
+    server_acceptor.accept(connection.server);
+    connection.client.set_option(tcp::no_delay(true));
+    connection.server.set_option(tcp::no_delay(true));
+
+    if (mode == "latency")
+    {
+        MeasureLatency(connection, samples);
+    }
+    else if (mode == "mixed")
+    {
+        MeasureLatencyUnderLoad(connection, samples);
+    }
+    else
+    {
+        std::cerr << "Unknown mode " << mode << std::endl;
+    }
+
+    asio::error_code ec;
+    connection.client.close(ec);
+    connection.server.close(ec);
+    proxy.reset();
+    work_guard.reset();
+    proxy_context.stop();
+    for (std::thread& t : proxy_threads)
+    {
+        t.join();
+    }
+
+    return 0;
+}
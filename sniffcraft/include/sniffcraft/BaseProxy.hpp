@@ -1,9 +1,9 @@
 #pragma once
 
 #include <atomic>
-#include <list>
+#include <chrono>
+#include <functional>
 #include <memory>
-#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
@@ -12,20 +12,30 @@
 
 #include "sniffcraft/Connection.hpp"
 #include "sniffcraft/enums.hpp"
+#include "sniffcraft/SpliceForwarder.hpp"
+
+/// @brief Maximum duration of the address resolution and of the connection to the server
+constexpr std::chrono::seconds UPSTREAM_CONNECT_TIMEOUT = std::chrono::seconds(10);
 
 /// @brief A base proxy class that will transfer all data
-/// both way without changing anything. Can be overriden by
-class BaseProxy
+/// both way without changing anything. Can be overriden by.
+/// Must be owned by a std::shared_ptr, every pending handler keeps a reference
+/// so the proxy is only destroyed once nothing can run on it anymore
+class BaseProxy : public std::enable_shared_from_this<BaseProxy>
 {
 public:
-    BaseProxy(asio::io_context& io_context);
+    /// @brief Create a new proxy
+    /// @param io_context Context running all the network operations
+    /// @param raw_forwarding If true and supported, data are moved between both sockets in kernel space, ProcessData is never called
+    BaseProxy(asio::io_context& io_context, const bool raw_forwarding = false);
     virtual ~BaseProxy();
 
-    /// @brief Starts the connection process to a given server
+    /// @brief Asynchronously starts the connection process to a given server.
+    /// Returns immediately, the callback is called on this proxy strand once done
     /// @param server_address IP address of the server
     /// @param server_port port to connect to
-    /// @return An error message if the connection couldn't be made
-    virtual std::optional<std::string> Start(const std::string& server_address, const unsigned short server_port);
+    /// @param callback Function called with an error message if the connection couldn't be made, std::nullopt otherwise
+    virtual void Start(const std::string& server_address, const unsigned short server_port, const std::function<void(const std::optional<std::string>&)>& callback);
 
     /// @brief Get the client connection underlying socket
     /// @return A reference to the client socket
@@ -34,11 +44,17 @@ public:
     bool Started();
     bool Running();
 
+    /// @brief Close this proxy if any of its connections didn't receive anything for too long
+    /// @param now Current time
+    /// @param timeout Max duration without receiving any data
+    void CloseIfIdle(const std::chrono::steady_clock::time_point now, const std::chrono::steady_clock::duration timeout);
+
 protected:
     /// @brief Function called when new data are available. On BaseProxy, just
     /// send the data to the other endpoint without any other processing. Override
-    /// to do more advanced stuff. It will always be called by one thread at the same
-    /// time, and you don't need to worry about any thread locking stuff.
+    /// to do more advanced stuff. Each direction is processed on its own lane: calls
+    /// with the same source are never concurrent, but calls with different sources
+    /// can be, so any state shared between both directions must be synchronized.
     /// @param data Iterator to the first element of the data
     /// @param length Size of the available data
     /// @param source Where the data are coming from
@@ -46,19 +62,86 @@ protected:
     /// be removed from the incoming buffer
     virtual size_t ProcessData(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source);
 
+    /// @brief Called on the strand once connected to the server, before starting to
+    /// transfer the data. On BaseProxy, just call done. Override to add an asynchronous
+    /// step to the start sequence
+    /// @param done Function to call on the strand when finished, with an error message if it failed
+    virtual void OnServerConnected(const std::function<void(const std::optional<std::string>&)>& done);
+
+    /// @brief Begin a new step of the start sequence, and log the duration of the previous one
+    /// @param stage Name of the new step
+    /// @param timeout Maximum duration of this step before the start is aborted
+    void BeginStartStage(const std::string& stage, const std::chrono::steady_clock::duration timeout);
+
+    /// @brief Get a slice referencing data given to ProcessData, to send them without copying
+    /// @param data Iterator to the first byte of the slice, must be in the range given to ProcessData
+    /// @param length Number of bytes in the slice
+    /// @param source Where the data are coming from
+    /// @return A slice keeping the bytes alive until it's destroyed
+    BufferSlice ShareData(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source);
+
+    /// @brief Stop processing the data coming from one endpoint for a while, without blocking
+    /// the lane thread. Must be called from this endpoint lane, usually from ProcessData.
+    /// Calling it again while the lane is paused restarts the pause with the new duration
+    /// @param source Endpoint to stop processing the data from
+    /// @param duration Time before the processing resumes
+    void PauseLane(const Endpoint source, const std::chrono::steady_clock::duration duration);
+
+    /// @brief Check if the processing of the data coming from one endpoint is paused, must be called from this endpoint lane
+    /// @param source Endpoint the data are coming from
+    /// @return True if PauseLane has been called and the processing didn't resume yet
+    bool IsLanePaused(const Endpoint source) const;
+
     /// @brief Close both client and server connections
     void Close();
 
 private:
-    /// @brief Use as callback when server connection has new data
-    void NotifyServerData(const size_t length);
-    /// @brief Use as callback when client connection has new data
-    void NotifyClientData(const size_t length);
-
-    /// @brief Function running in data_processing_thread
-    void ReadIncomingData();
+    /// @brief Log the duration of the current stage of the start sequence
+    void EndStartStage();
+    void handle_resolve(const asio::error_code& ec, const asio::ip::tcp::resolver::results_type& results);
+    void handle_connect(const asio::error_code& ec, const asio::ip::tcp::endpoint& endpoint);
+    void handle_start_timeout(const asio::error_code& ec);
+    /// @brief End the start sequence, start transferring data if there was no error
+    /// @param error Error message if something failed
+    void FinishStart(const std::optional<std::string>& error);
+
+    /// @brief Try to start forwarding the data with splice in both directions
+    /// @return True if started, false if the regular path must be used
+    bool StartRawForwarding();
+
+    /// @brief Called when a splice forwarder stops, close the proxy on error or once both directions are done
+    void OnRawForwardingStopped();
+
+    /// @brief Use as callback when one connection has new data, or when
+    /// the destination of the data received from one connection is drained
+    /// @param source Endpoint the data to process are coming from
+    void NotifyNewData(const Endpoint source);
+
+    /// @brief Process all the available data from one endpoint, posted on this endpoint lane when new data are received
+    /// @param source Endpoint to process the data from
+    void ReadIncomingData(const Endpoint source);
+
+    /// @brief Call ProcessData once on the data received from one endpoint
+    /// @param source Endpoint to process the data from
+    /// @return True if some data have been consumed, false if we need to wait for more
+    bool ProcessReceivedData(const Endpoint source);
+
+    /// @brief Drop the already processed bytes of spilled data before appending new ones.
+    /// If some of them are still shared, a new vector is used instead to keep the slices valid
+    /// @param spilled_data Spilled data to prepare
+    /// @param spilled_data_start Index of the first non processed byte in spilled_data
+    void CompactSpilledData(std::shared_ptr<std::vector<unsigned char>>& spilled_data, size_t& spilled_data_start);
 
 protected:
+    /// @brief Strand all the socket operations of this proxy are serialized on,
+    /// both connections handlers and the start sequence
+    asio::strand<asio::io_context::executor_type> strand;
+    /// @brief Strand processing the data coming from the client, so a burst of
+    /// clientbound data never delays the serverbound ones
+    asio::strand<asio::io_context::executor_type> client_lane;
+    /// @brief Strand processing the data coming from the server
+    asio::strand<asio::io_context::executor_type> server_lane;
+
     /// @brief In/Out connection to the client
     Connection client_connection;
     /// @brief In/Out connection to the server
@@ -68,28 +151,48 @@ protected:
     unsigned short server_port_;
 
 private:
-    asio::io_context& io_context_;
-
-    /// @brief Running thread to process incoming data from
-    /// both client and server
-    std::thread data_processing_thread;
-
-    /// @brief Everytime one connection has data,
-    /// it adds the source Endpoint in this queue
-    /// and the number of bytes transferred this time
-    std::list<std::pair<Endpoint, size_t> > data_sources;
-    /// @brief Mutex to protect the data_sources
-    std::mutex data_sources_mutex;
-    /// @brief Condition variable notified everytime
-    /// there is a new entry in data_sources
-    std::condition_variable data_source_cv;
-
-    /// @brief History of data received by the client connection
-    std::vector<unsigned char> client_received_data;
-    /// @brief History of data received by the server connection
-    std::vector<unsigned char> server_received_data;
-
-    std::atomic<bool> process_data_ready;
+    asio::ip::tcp::resolver resolver;
+    /// @brief Timer aborting the current stage of the start sequence
+    asio::steady_timer start_timer;
+    /// @brief Function to call when the start sequence is done, empty once called
+    std::function<void(const std::optional<std::string>&)> start_callback;
+    /// @brief Name of the current stage of the start sequence
+    std::string start_stage;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point start_stage_time;
+
+    /// @brief If true, try to use splice forwarders instead of the connections read/write
+    const bool raw_forwarding;
+    std::unique_ptr<SpliceForwarder> client_to_server_forwarder;
+    std::unique_ptr<SpliceForwarder> server_to_client_forwarder;
+
+    /// @brief Set to true when ReadIncomingData(Endpoint::Client) is posted on
+    /// client_lane, back to false when it starts processing the data
+    std::atomic<bool> client_processing_scheduled;
+    /// @brief Set to true when ReadIncomingData(Endpoint::Server) is posted on
+    /// server_lane, back to false when it starts processing the data
+    std::atomic<bool> server_processing_scheduled;
+
+    /// @brief Bytes moved out of the client ring buffer, when the next packet
+    /// is split at the end of it or is too big to fit into it. Shared with the slices referencing it
+    std::shared_ptr<std::vector<unsigned char>> client_spilled_data;
+    /// @brief Index of the first non processed byte in client_spilled_data
+    size_t client_spilled_data_start;
+    /// @brief Bytes moved out of the server ring buffer, when the next packet
+    /// is split at the end of it or is too big to fit into it. Shared with the slices referencing it
+    std::shared_ptr<std::vector<unsigned char>> server_spilled_data;
+    /// @brief Index of the first non processed byte in server_spilled_data
+    size_t server_spilled_data_start;
+
+    /// @brief Timer resuming the client lane processing after a pause, its handler runs on client_lane
+    asio::steady_timer client_lane_timer;
+    /// @brief True while the client lane processing is paused, only used on client_lane
+    bool client_lane_paused;
+    /// @brief Timer resuming the server lane processing after a pause, its handler runs on server_lane
+    asio::steady_timer server_lane_timer;
+    /// @brief True while the server lane processing is paused, only used on server_lane
+    bool server_lane_paused;
+
     std::atomic<bool> closed;
     std::atomic<bool> started;
 };
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+struct BufferPoolStats
+{
+    /// @brief Number of buffers (or slice owners) taken back from the pool
+    size_t hits = 0;
+    /// @brief Number of buffers (or slice owners) that had to be allocated on the heap
+    size_t misses = 0;
+    /// @brief Number of released buffers freed instead of being kept in the pool
+    size_t dropped = 0;
+};
+
+/// @brief Counters shared by the buffer pool and the PoolAllocator used for the slices owners
+struct BufferPoolCounters
+{
+    static inline std::atomic<size_t> heap_allocations = 0;
+    static inline std::atomic<size_t> reused_allocations = 0;
+    static inline std::atomic<size_t> dropped = 0;
+};
+
+/// @brief A byte vector borrowed from the buffer pool and given back to it
+/// when destroyed, keeping its capacity for the next user. The underlying
+/// vector can be accessed with * and -> for the functions requiring one
+class PooledBuffer
+{
+public:
+    /// @brief Create an empty buffer, not taken from the pool
+    PooledBuffer();
+    /// @brief Take ownership of a vector, that will be given to the pool on destruction
+    /// @param bytes Vector to take ownership of
+    explicit PooledBuffer(std::vector<unsigned char>&& bytes);
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer();
+
+    std::vector<unsigned char>& operator*();
+    const std::vector<unsigned char>& operator*() const;
+    std::vector<unsigned char>* operator->();
+    const std::vector<unsigned char>* operator->() const;
+
+    unsigned char* data();
+    const unsigned char* data() const;
+    size_t size() const;
+    bool empty() const;
+    std::vector<unsigned char>::const_iterator cbegin() const;
+    std::vector<unsigned char>::const_iterator cend() const;
+
+private:
+    std::vector<unsigned char> bytes;
+};
+
+/// @brief Get an empty buffer from the pool. Buffers are sorted in power of
+/// two capacity classes, each thread keeps a few small ones for itself and
+/// everything else is shared between all threads
+/// @param capacity Minimum number of bytes the buffer can hold without allocation
+/// @return An empty buffer with at least capacity bytes reserved
+PooledBuffer AcquireBuffer(const size_t capacity);
+
+/// @brief Get the pool statistics since program start
+BufferPoolStats GetBufferPoolStats();
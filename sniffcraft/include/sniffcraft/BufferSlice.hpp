@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "sniffcraft/BufferPool.hpp"
+
+/// @brief A read-only view on a range of bytes that shares the ownership
+/// of the memory they are stored in. Copying a slice never copies the bytes,
+/// they stay valid as long as at least one slice referencing them is alive
+class BufferSlice
+{
+public:
+    /// @brief Create an empty slice
+    BufferSlice();
+
+    /// @brief Create a slice owning the given bytes, given back to the pool once all the slices are released
+    /// @param bytes Data to take ownership of
+    BufferSlice(PooledBuffer&& bytes);
+
+    /// @brief Create a slice referencing bytes kept alive by owner
+    /// @param owner Anything keeping the referenced memory valid until released
+    /// @param data Pointer to the first byte of the slice
+    /// @param length Number of bytes in the slice
+    BufferSlice(const std::shared_ptr<const void>& owner, unsigned char* const data, const size_t length);
+
+    const unsigned char* data() const;
+    /// @brief Get writable access to the bytes, to transform them in place. Only
+    /// safe if no other slice references the same bytes, which is always true
+    /// for the slices sent with Connection::WriteData
+    unsigned char* mutable_data();
+    size_t size() const;
+    bool empty() const;
+
+private:
+    std::shared_ptr<const void> owner;
+    unsigned char* ptr;
+    size_t length;
+};
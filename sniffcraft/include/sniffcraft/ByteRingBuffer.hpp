@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "sniffcraft/BufferSlice.hpp"
+
+/// @brief A fixed capacity ring buffer of bytes. One thread can write
+/// while another one reads without any lock. Calling producer functions
+/// (or consumer ones) from more than one thread at the same time is not supported.
+/// Consumed bytes can be shared as BufferSlice, their space is given back to
+/// the producer only once all the slices referencing them are destroyed
+class ByteRingBuffer : public std::enable_shared_from_this<ByteRingBuffer>
+{
+public:
+    /// @brief Create a new ring buffer
+    /// @param capacity Size of the buffer in bytes, must be a power of two
+    ByteRingBuffer(const size_t capacity);
+
+    /// @brief Producer side, get the number of bytes that can be written
+    /// @return Number of free bytes in the buffer
+    size_t WritableSize() const;
+
+    /// @brief Producer side, copy bytes at the end of the buffer
+    /// @param data Pointer to the first byte to copy
+    /// @param length Number of bytes to copy
+    /// @return The number of bytes actually written, can be less than length if the buffer is full
+    size_t Write(const unsigned char* const data, const size_t length);
+
+    /// @brief Producer side, get the first free byte, to write into the buffer without an intermediate copy.
+    /// Written bytes are not visible to the consumer until Commit is called
+    /// @param contiguous_size Output parameter, number of free bytes stored contiguously after the returned pointer
+    /// @return A pointer to the first free byte
+    unsigned char* WriteRegion(size_t& contiguous_size);
+
+    /// @brief Producer side, make bytes written in the region returned by WriteRegion visible to the consumer
+    /// @param length Number of bytes written, can't be more than the contiguous size returned by WriteRegion
+    void Commit(const size_t length);
+
+    /// @brief Consumer side, get the number of bytes that can be read
+    /// @return Number of bytes written but not consumed yet
+    size_t ReadableSize() const;
+
+    /// @brief Consumer side, get the first readable byte
+    /// @param contiguous_size Output parameter, number of readable bytes stored contiguously after the returned iterator
+    /// @return An iterator to the first readable byte
+    std::vector<unsigned char>::const_iterator Front(size_t& contiguous_size) const;
+
+    /// @brief Consumer side, mark bytes as read so their space can be reused
+    /// @param length Number of bytes to release
+    void Consume(const size_t length);
+
+    /// @brief Consumer side, append all the readable bytes at the end of dst and consume them
+    /// @param dst Vector the data will be appended to
+    /// @return The number of bytes moved
+    size_t MoveTo(std::vector<unsigned char>& dst);
+
+    /// @brief Consumer side, get a slice referencing readable bytes without copying them.
+    /// The buffer must be owned by a std::shared_ptr
+    /// @param first Pointer to the first byte of the slice, must be in the contiguous readable range
+    /// @param length Number of bytes in the slice
+    /// @return A slice keeping the bytes from being overwritten until it's destroyed
+    BufferSlice Share(const unsigned char* const first, const size_t length);
+
+    /// @brief Set a function called every time some space is given back
+    /// to the producer after shared slices have been destroyed
+    /// @param callback Function to call, can be empty
+    void SetReleaseCallback(const std::function<void()>& callback);
+
+private:
+    /// @brief Mark a shared range as not used anymore
+    /// @param id Id of the range returned when it was shared
+    void Release(const size_t id);
+
+    /// @brief Move release_position to the first byte still in use. retained_mutex must be locked
+    /// @return True if release_position changed
+    bool UpdateReleasePosition();
+
+private:
+    std::vector<unsigned char> data;
+    const size_t mask;
+
+    /// @brief Total number of bytes ever written, only modified by the producer
+    std::atomic<size_t> write_position;
+    /// @brief Total number of bytes ever consumed, only modified by the consumer
+    std::atomic<size_t> read_position;
+    /// @brief Total number of bytes given back to the producer, always <= read_position
+    std::atomic<size_t> release_position;
+
+    /// @brief Protect retained, first_retained_id and release_callback
+    std::mutex retained_mutex;
+    /// @brief Start position of all shared ranges, in sharing order, and whether they have been released
+    std::deque<std::pair<size_t, bool>> retained;
+    /// @brief Id of retained front element
+    size_t first_retained_id;
+    std::function<void()> release_callback;
+};
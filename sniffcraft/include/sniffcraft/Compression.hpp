@@ -3,12 +3,82 @@
 #include <vector>
 #include <cstddef>
 #include <fstream>
+#include <memory>
 #include <tuple>
 
+struct z_stream_s;
+#ifdef USE_LIBDEFLATE
+struct libdeflate_compressor;
+struct libdeflate_decompressor;
+#endif
+
 
-std::vector<unsigned char> Compress(const std::vector<unsigned char> &data);
 std::vector<unsigned char> Decompress(const unsigned char* compressed, const size_t size);
 
+/// @brief A zlib inflate stream reused for all the packets of a connection direction,
+/// with a reused output buffer, instead of initializing new ones for each packet.
+/// If compiled with libdeflate, it is used for whole packets as their size is known.
+/// Not thread safe, use one per thread
+class Decompressor
+{
+public:
+    Decompressor();
+    ~Decompressor();
+
+    /// @brief Decompress data with a known decompressed size
+    /// @param compressed Pointer to the compressed data
+    /// @param size Size of the compressed data
+    /// @param decompressed_size Expected size of the decompressed data, as sent in the packet data length
+    /// @return A reference to the decompressed data, valid until the next call
+    const std::vector<unsigned char>& Decompress(const unsigned char* compressed, const size_t size, const size_t decompressed_size);
+
+    /// @brief Decompress only the beginning of some compressed data
+    /// @param compressed Pointer to the compressed data
+    /// @param size Size of the compressed data
+    /// @param max_size Maximum number of decompressed bytes to produce
+    /// @return A reference to at most max_size first bytes of the decompressed data, valid until the next call
+    const std::vector<unsigned char>& DecompressHead(const unsigned char* compressed, const size_t size, const size_t max_size);
+
+private:
+    /// @brief Still used with libdeflate for DecompressHead, as libdeflate can't stop before the end
+    std::unique_ptr<z_stream_s> stream;
+#ifdef USE_LIBDEFLATE
+    libdeflate_decompressor* decompressor;
+#endif
+    std::vector<unsigned char> output;
+};
+
+/// @brief A zlib deflate stream reused for all the compressed data, with a reused
+/// output buffer, instead of initializing new ones each time. If compiled with
+/// libdeflate, it is used instead of zlib, still producing zlib format. Not thread safe
+class Compressor
+{
+public:
+    /// @brief Create a new compressor
+    /// @param level zlib compression level, from 0 (none) to 9 (best ratio), -1 for zlib default
+    Compressor(const int level);
+    ~Compressor();
+
+    /// @brief Change the compression level used for the next data
+    /// @param level zlib compression level, from 0 (none) to 9 (best ratio), -1 for zlib default
+    void SetLevel(const int level);
+
+    /// @brief Compress some data
+    /// @param data Pointer to the data to compress
+    /// @param size Size of the data
+    /// @return A reference to the compressed data, valid until the next call
+    const std::vector<unsigned char>& Compress(const unsigned char* data, const size_t size);
+
+private:
+#ifdef USE_LIBDEFLATE
+    libdeflate_compressor* compressor;
+#else
+    std::unique_ptr<z_stream_s> stream;
+#endif
+    int level;
+    std::vector<unsigned char> output;
+};
+
 /// @brief Compress an input file directly to an output, without loading it in memory
 /// @param src_file Source file to compress
 /// @param dst_file Destination file to write to
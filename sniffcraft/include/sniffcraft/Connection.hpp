@@ -1,45 +1,94 @@
 #pragma once
 
 #include <atomic>
-#include <deque>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <thread>
 #include <vector>
 
 #include <asio.hpp>
 
-constexpr size_t BUFFER_SIZE = 1024;
+#include "sniffcraft/BufferSlice.hpp"
+#include "sniffcraft/ByteRingBuffer.hpp"
+
+/// @brief Max size of a single socket read when a connection is created, and minimum size when shrinking
+constexpr size_t MIN_READ_BUFFER_SIZE = 1024;
+/// @brief Default maximum size a single socket read can grow to
+constexpr size_t DEFAULT_MAX_READ_BUFFER_SIZE = 128 * 1024;
+/// @brief Capacity of the ring buffer storing received data until they are processed, must be a power of two
+constexpr size_t RECEIVED_DATA_BUFFER_SIZE = 512 * 1024;
+/// @brief Default number of pending bytes to write above which the write queue is considered full
+constexpr size_t DEFAULT_WRITE_HIGH_WATERMARK = 4 * 1024 * 1024;
+/// @brief Default number of pending bytes to write below which a full write queue is considered drained
+constexpr size_t DEFAULT_WRITE_LOW_WATERMARK = 1024 * 1024;
 
 class DataProcessor;
 
 class Connection
 {
 public:
-	Connection(asio::io_context& io_context);
+	/// @brief Create a new connection
+	/// @param strand Strand all the socket operations and handlers will run on
+	Connection(const asio::strand<asio::io_context::executor_type>& strand);
 	~Connection();
 
+	/// @brief Setter for the object owning this connection. Every pending handler keeps it alive,
+	/// so the connection can't be destroyed while one of them can still run. Must be called
+	/// before starting reading or writing
+	/// @param owner Weak reference to the owner
+	void SetOwner(const std::weak_ptr<void>& owner);
+
 	/// @brief Setter for the callback called on data reception
 	/// @param callback a function to call
-	void SetCallback(const std::function<void(const size_t)>& callback);
+	void SetCallback(const std::function<void()>& callback);
 
 	/// @brief Setter for the data processor
 	/// @param processor The processor this connection will take ownership of
 	void SetDataProcessor(std::unique_ptr<DataProcessor>& processor);
 
-	/// @brief Get all available ready data in ready_received_data and clear the vector
-	/// @param dst Vector to which the data will be pushed to
-	void RetreiveData(std::vector<unsigned char>& dst);
+	/// @brief Setter for the maximum size a single socket read can grow to
+	/// @param size Max size in bytes, can't be less than MIN_READ_BUFFER_SIZE
+	void SetMaxReadBufferSize(const size_t size);
+
+	/// @brief Setter for the write queue watermarks
+	/// @param high Number of pending bytes above which the write queue is full
+	/// @param low Number of pending bytes below which a full write queue is drained again, can't be more than high
+	void SetWriteWatermarks(const size_t high, const size_t low);
+
+	/// @brief Setter for the callback called when a full write queue goes below the low watermark
+	/// @param callback a function to call
+	void SetWriteDrainedCallback(const std::function<void()>& callback);
+
+	/// @brief Check if too many bytes are waiting to be written. Once full, the queue
+	/// stays full until the pending bytes go below the low watermark
+	/// @return True if the queue went above the high watermark and is not drained yet
+	bool IsWriteQueueFull() const;
+
+	/// @brief Get the number of bytes waiting to be written or being written
+	/// @return The size of the write queue in bytes
+	size_t GetPendingWriteBytes() const;
+
+	/// @brief Get the buffer received data are written to. Only one thread should consume it
+	/// @return A reference to the received data ring buffer
+	ByteRingBuffer& GetReceivedData();
+
+	/// @brief Must be called after consuming received data, to resume reading from the socket
+	/// if it was paused because the received data buffer was full
+	void NotifyDataConsumed();
 
 	/// @brief Start writing/reading data to/from this socket
 	void StartListeningAndWriting();
 
-	/// @brief Push given data to the buffer to be sent through the socket
+	/// @brief Push a copy of given data to the buffer to be sent through the socket
 	/// @param data Pointer to the first data element
 	/// @param length Size of the data in bytes
 	void WriteData(const unsigned char* const data, const size_t length);
 
+	/// @brief Push given data to the buffer to be sent through the socket, without copying them
+	/// @param data Slice to send, the bytes are kept alive until the write is done
+	void WriteData(BufferSlice&& data);
+
 	/// @brief Getter for this connection underlying socket
 	/// @return A reference to asio socket
 	asio::ip::tcp::socket& GetSocket();
@@ -51,40 +100,81 @@ public:
 	/// @return True if closed, false otherwise
 	bool Closed() const;
 
+	/// @brief Record that some data were just received from this connection socket. Called
+	/// internally on each read, and by anything else reading the socket directly
+	void StampActivity();
+
+	/// @brief Stop checking this connection for idleness, when nothing can be received from it anymore
+	void StopIdleCheck();
+
+	/// @brief Check if nothing has been received for too long
+	/// @param now Current time
+	/// @param timeout Max duration without receiving any data
+	/// @return True if the connection is listening and nothing was received since now - timeout
+	bool IsIdle(const std::chrono::steady_clock::time_point now, const std::chrono::steady_clock::duration timeout) const;
+
 private:
-	void WriteLoop();
+	/// @brief Send everything in data_to_write with a single async write, called in the asio thread
+	void StartWriting();
+	/// @brief Release the written data, async_write only completes once all of it has been sent or on error
+	void handle_write(const asio::error_code& ec);
+	/// @brief Issue the next read directly into received_data free space, or pause reading if there is none left
+	void StartReading();
 	void handle_read(const asio::error_code& ec, const size_t bytes_transferred);
-	void handle_timeout(const asio::error_code& ec);
+	/// @brief Grow or shrink read_size depending on how much of it was filled by the last read
+	/// @param bytes_transferred Number of bytes received by the last read
+	void AdaptReadBufferSize(const size_t bytes_transferred);
 
 private:
 	std::atomic<bool> closed;
-	/// @brief Function called when N new bytes were added in ready_received_data
-	std::function<void(const size_t)> data_callback;
+	/// @brief Object owning this connection, locked by every posted handler
+	std::weak_ptr<void> owner;
+	/// @brief Function called when new bytes were added in received_data
+	std::function<void()> data_callback;
 
 	/// @brief Connection underlying socket
 	asio::ip::tcp::socket socket;
-	asio::steady_timer timeout_timer;
-
-	/// @brief BUFFER_SIZE vector used to store incoming bytes
-	std::vector<unsigned char> read_buffer;
-	/// @brief Growing buffer storing all the received bytes ready to be processed. Protected by received_mutex
-	std::vector<unsigned char> ready_received_data;
-	/// @brief mutex protecting ready_received_data
-	std::mutex received_mutex;
-
-	/// @brief Thread running the sync writing loop
-	std::thread write_thread;
-	std::atomic<bool> write_thread_started;
-	/// @brief A deque of data to send. If second parameter bool is set to true, means that we need to apply data_processor to it before sending
-	std::deque<std::pair<std::vector<unsigned char>, bool>> data_to_write;
-	/// @brief mutex protecting data_to_write
+	/// @brief Last time some data were received, in steady_clock ticks. 0 if not listening (yet or anymore).
+	/// Only stamped here, idle connections are detected by a periodic check in Server
+	std::atomic<std::chrono::steady_clock::rep> last_activity;
+
+	/// @brief Max number of bytes requested by a single read, adapted to the observed throughput
+	size_t read_size;
+	/// @brief Max size read_size can grow to
+	std::atomic<size_t> max_read_buffer_size;
+	/// @brief Number of consecutive reads that used less than a quarter of read_size
+	int small_reads_count;
+	/// @brief Ring buffer storing all the received bytes ready to be processed. The socket
+	/// reads directly into it in the asio thread, consumed by the data processing thread.
+	/// Shared with the slices referencing it as they can be destroyed after this connection
+	std::shared_ptr<ByteRingBuffer> received_data;
+	/// @brief True if we stopped reading from the socket until some space is available in received_data
+	std::atomic<bool> reading_paused;
+
+	/// @brief Data to send. If second parameter bool is set to true, means that we need to apply data_processor to it before sending
+	std::vector<std::pair<BufferSlice, bool>> data_to_write;
+	/// @brief True if an async write is running or scheduled, no new write is posted until it's done
+	bool write_in_progress;
+	/// @brief mutex protecting data_to_write and write_in_progress
 	std::mutex write_mutex;
-	/// @brief condition variable notified when a new data is added to data_to_write
-	std::condition_variable write_cv;
+	/// @brief Data currently sent by the async write, only used in the asio thread
+	std::vector<BufferSlice> data_being_written;
+	/// @brief Size of data_being_written before being processed by data_processor
+	size_t data_being_written_bytes;
+	/// @brief Bytes in data_to_write and data_being_written
+	std::atomic<size_t> pending_write_bytes;
+	std::atomic<size_t> write_high_watermark;
+	std::atomic<size_t> write_low_watermark;
+	/// @brief True when pending_write_bytes went above write_high_watermark and not below write_low_watermark since
+	std::atomic<bool> write_queue_full;
+	/// @brief Function called when write_queue_full goes back to false
+	std::function<void()> write_drained_callback;
+	/// @brief Buffers pointing to all data_being_written elements
+	std::vector<asio::const_buffer> write_buffers;
 
 	/// @brief Optional DataProcessor applied to all incoming and outgoing data
 	std::unique_ptr<DataProcessor> data_processor;
-	/// @brief Mutex protecting data_processor. Used in three threads calling handle_read, WriteData/WriteLoop and SetDataProcessor
+	/// @brief Mutex protecting data_processor. Used in three threads calling handle_read, WriteData/StartWriting and SetDataProcessor
 	std::mutex data_processor_mutex;
 
 };
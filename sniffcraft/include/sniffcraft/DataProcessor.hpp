@@ -1,6 +1,6 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
 
 class DataProcessor
 {
@@ -8,6 +8,12 @@ public:
 	DataProcessor() {};
 	virtual ~DataProcessor() {};
 
-	virtual std::vector<unsigned char> ProcessIncomingData(const std::vector<unsigned char>& data) const = 0;
-	virtual std::vector<unsigned char> ProcessOutgoingData(const std::vector<unsigned char>& data) const = 0;
+	/// @brief Transform received data in place, must not change their size
+	/// @param data Pointer to the first byte to process
+	/// @param length Number of bytes to process
+	virtual void ProcessIncomingData(unsigned char* const data, const size_t length) = 0;
+	/// @brief Transform data to send in place, must not change their size
+	/// @param data Pointer to the first byte to process
+	/// @param length Number of bytes to process
+	virtual void ProcessOutgoingData(unsigned char* const data, const size_t length) = 0;
 };
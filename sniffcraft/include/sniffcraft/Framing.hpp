@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/// @brief A complete Minecraft packet found in received data
+struct Frame
+{
+    /// @brief Size of the packet length VarInt
+    size_t length_size;
+    /// @brief Size of the packet, without the packet length VarInt
+    size_t packet_size;
+};
+
+/// @brief Read a VarInt without throwing if there are not enough bytes
+/// @param data Pointer to the first byte of the VarInt
+/// @param length Number of available bytes
+/// @param value Decoded value, only set if the VarInt is complete
+/// @return Number of bytes of the VarInt, 0 if it's incomplete or longer than 5 bytes
+size_t ReadVarIntNoThrow(const unsigned char* const data, const size_t length, int& value);
+
+/// @brief Get the number of bytes needed to write a VarInt
+/// @param value Value of the VarInt
+/// @return Size of the VarInt in bytes, between 1 and 5
+size_t VarIntSize(const int value);
+
+/// @brief Scan some data once and find all the complete packets at their beginning
+/// @param data Pointer to the first byte of a packet length
+/// @param length Number of available bytes
+/// @param frames Output vector, cleared and filled with all the complete packets, in order
+/// @return Number of bytes of all the complete packets
+size_t FindCompleteFrames(const unsigned char* const data, const size_t length, std::vector<Frame>& frames);
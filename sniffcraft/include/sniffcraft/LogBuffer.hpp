@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/// @brief A text buffer to format log lines, without any allocation once it's
+/// big enough. Many lines are appended before being written at once
+class LogBuffer
+{
+public:
+    LogBuffer();
+
+    void Append(const std::string_view s);
+    void Append(const char c);
+
+    /// @brief Append an unsigned integer in base 10
+    /// @param value Value to append
+    /// @param min_digits Minimum number of digits, padded with leading 0
+    void AppendNumber(unsigned long long value, const int min_digits = 1);
+
+    /// @brief Append a [h:mm:ss:mmm] timestamp
+    /// @param elapsed_ms Number of milliseconds to format
+    void AppendTimestamp(const long long int elapsed_ms);
+
+    /// @brief Append bytes as space separated 0xXX values
+    /// @param data Pointer to the first byte
+    /// @param size Number of bytes
+    void AppendHex(const unsigned char* data, const size_t size);
+
+    /// @brief Write all the content to a stream, without flushing it
+    /// @param stream Stream to write to
+    void WriteTo(std::ostream& stream) const;
+
+    /// @brief Remove all the content, keeping the memory for the next lines
+    void Clear();
+
+    size_t Size() const;
+    bool Empty() const;
+
+private:
+    std::string buffer;
+};
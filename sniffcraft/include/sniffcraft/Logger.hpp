@@ -1,7 +1,9 @@
 #pragma once
 
 #include "sniffcraft/enums.hpp"
+#include "sniffcraft/LogBuffer.hpp"
 #include "sniffcraft/LogItem.hpp"
+#include "sniffcraft/LoggingEngine.hpp"
 #include "sniffcraft/NetworkRecapItem.hpp"
 
 #include <protocolCraft/enums.hpp>
@@ -10,26 +12,50 @@
 
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <set>
 #include <string_view>
-#include <thread>
+#include <vector>
 
-class Logger
+class Compressor;
+
+/// @brief Formatted log lines are written once they reach this size, or after LOG_FLUSH_INTERVAL
+constexpr size_t LOG_FLUSH_SIZE = 64 * 1024;
+
+/// @brief Logging session of one connection, its packets are logged by the LoggingEngine workers
+class Logger : public LogSession
 {
 public:
     Logger();
 #ifdef WITH_GUI
     Logger(const std::filesystem::path& path);
 #endif
-    ~Logger();
+    virtual ~Logger();
     void Log(const std::shared_ptr<ProtocolCraft::Packet>& packet, const ProtocolCraft::ConnectionState connection_state, const Endpoint origin, const size_t bandwidth_bytes);
+    /// @brief Log several packets at once, waking the log worker only once
+    /// @param items Packets to log, in order
+    void Log(std::vector<LogItem>&& items);
+    /// @brief Account for a packet that has been transmitted without being parsed
+    /// @param connection_state Connection state the packet was sent in
+    /// @param origin Origin of the packet
+    /// @param packet_id ID of the packet
+    /// @param bandwidth_bytes Size of the packet on the network
+    void LogSkipped(const ProtocolCraft::ConnectionState connection_state, const Endpoint origin, const int packet_id, const size_t bandwidth_bytes);
+    /// @brief Get the packets that are not needed by this logger with the current configuration
+    /// @param connection_state Connection state of the packets
+    /// @param origin Origin of the packets, either Endpoint::Client or Endpoint::Server
+    /// @return A set of packet ids that can be transmitted without being parsed (empty if all packets are needed)
+    std::set<int> GetSkippablePackets(const ProtocolCraft::ConnectionState connection_state, const Endpoint origin);
+    /// @brief Update the number of bytes waiting to be sent in one direction, displayed in the network recap
+    /// @param origin Origin of the data waiting to be sent, either Endpoint::Client or Endpoint::Server
+    /// @param pending_bytes Size of the destination write queue in bytes
+    void UpdateWriteQueueDepth(const Endpoint origin, const size_t pending_bytes);
+    /// @brief Get a counter incremented everytime the configuration is reloaded
+    unsigned int GetConfVersion() const;
     const std::string& GetBaseFilename() const;
     void LoadConfig();
     void Stop();
@@ -41,8 +67,19 @@ public:
     void UpdateFilteredPackets();
 #endif
 
+protected:
+    virtual void Consume(LogItem& item) override;
+    virtual void OnBatchEnd() override;
+    /// @brief Write the formatted lines to the log file and/or console and flush them
+    virtual void Flush() override;
+    virtual void OnClose() override;
+
 private:
-    void LogConsume();
+    /// @brief Create the log files if they are enabled and not created yet, only called by the log worker
+    void CreateLogFiles();
+    /// @brief Append the [time] state origin part of a log line
+    /// @param item LogItem of the line
+    void AppendLineHeader(const LogItem& item);
     void LoadPacketsFromJson(const ProtocolCraft::Json::Value& value, const ProtocolCraft::ConnectionState connection_state);
     std::string_view OriginToString(const Endpoint origin) const;
     std::string_view ConnectionStateToString(const ProtocolCraft::ConnectionState connection_state) const;
@@ -50,16 +87,21 @@ private:
     /// @param item LogItem
     /// @return Displayable packet name
     std::string GetPacketName(const LogItem& item) const;
+    /// @brief Get packet name (default packet name + identifier if it's a custom payload)
+    /// @param item LogItem
+    /// @param packet_name String to store the name in, reusing its memory
+    void GetPacketName(const LogItem& item, std::string& packet_name) const;
     Endpoint SimpleOrigin(const Endpoint origin) const;
+    void UpdateNetworkRecap(const std::string& packet_name, const Endpoint origin, const size_t bandwidth_bytes);
     std::string GenerateNetworkRecap(const int max_entry = -1, const int max_name_size = -1) const;
 
 private:
     std::chrono::time_point<std::chrono::system_clock> start_time;
 
-    std::thread log_thread;
-    std::mutex log_mutex;
-    std::condition_variable log_condition;
-    std::queue<LogItem> logging_queue;
+    /// @brief Formatted lines not written yet, only used by the log worker
+    LogBuffer log_buffer;
+    /// @brief Reused to get the name of the consumed packets, only used by the log worker
+    std::string consumed_packet_name;
 
     std::string base_filename;
     std::ofstream log_file;
@@ -70,23 +112,39 @@ private:
     bool log_to_console;
     bool log_raw_bytes;
     bool log_network_recap_console;
+    /// @brief zlib level used to compress the binary file records, favors ratio by default
+    std::atomic<int> capture_compression_level;
+    /// @brief Deflate stream for the binary file records, only used by the log worker
+    std::unique_ptr<Compressor> capture_compressor;
 #ifdef WITH_GUI
     bool in_gui;
 #endif
 
-    std::time_t last_time_checked_conf_file;
+    /// @brief Engine conf generation this session last reloaded its conf for
+    unsigned int applied_conf_generation;
     std::time_t last_time_conf_file_loaded;
     std::time_t last_time_network_recap_printed;
+    std::atomic<unsigned int> conf_version;
 
     std::map<std::pair<ProtocolCraft::ConnectionState, Endpoint>, std::set<int> > ignored_packets;
     std::mutex ignored_packets_mutex;
     std::map<std::pair<ProtocolCraft::ConnectionState, Endpoint>, std::set<int> > detailed_packets;
+    using SkippablePacketsMap = std::map<std::pair<ProtocolCraft::ConnectionState, Endpoint>, std::set<int> >;
+    /// @brief Immutable snapshot of the packets that can be transmitted without being parsed, read by the
+    /// network threads with std::atomic_load and replaced as a whole each time the conf is loaded
+    std::shared_ptr<const SkippablePacketsMap> skippable_packets;
 
     std::map<std::string, NetworkRecapItem> clientbound_network_recap_data;
     std::map<std::string, NetworkRecapItem> serverbound_network_recap_data;
     mutable std::mutex network_recap_mutex;
     NetworkRecapItem clientbound_total_network_recap;
     NetworkRecapItem serverbound_total_network_recap;
+    /// @brief Last observed and max size of the write queue to the client
+    std::atomic<size_t> clientbound_write_queue_bytes;
+    std::atomic<size_t> clientbound_max_write_queue_bytes;
+    /// @brief Last observed and max size of the write queue to the server
+    std::atomic<size_t> serverbound_write_queue_bytes;
+    std::atomic<size_t> serverbound_max_write_queue_bytes;
 
 #ifdef WITH_GUI
     std::vector<LogItem> packets_history;
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "sniffcraft/LogItem.hpp"
+#include "sniffcraft/MPSCQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief Number of record slots in each logging worker queue, producers wait if it's full
+constexpr size_t LOGGING_QUEUE_SIZE = 65536;
+/// @brief Buffered data of the sessions is written once it's older than this interval, or when a worker has nothing left to process
+constexpr std::chrono::milliseconds LOG_FLUSH_INTERVAL(100);
+/// @brief Sessions without any record are given a chance to react to conf changes at this interval
+constexpr std::chrono::seconds LOG_IDLE_CHECK_INTERVAL(1);
+
+class LoggingEngine;
+
+/// @brief Base class of the per connection loggers. The object itself is only a light
+/// handle owned by the proxy, its records are processed by one of the LoggingEngine
+/// workers. A session is always processed by the same worker, so its records stay in
+/// order and all the virtual functions below are called from this single thread
+class LogSession
+{
+public:
+    LogSession();
+    virtual ~LogSession();
+
+protected:
+    /// @brief Register this session in the engine, records can be pushed after this call
+    void OpenSession();
+    /// @brief Send one item to this session worker
+    /// @param item Item to process
+    void PushRecord(LogItem&& item);
+    /// @brief Send several items to this session worker, waking it only once
+    /// @param items Items to process, in order
+    void PushRecords(std::vector<LogItem>&& items);
+    /// @brief Ask the worker to close this session once everything already pushed has been processed.
+    /// Items pushed after this call are dropped
+    void CloseSession();
+    /// @brief Close the session if needed and wait for its worker to be done with it. Must be
+    /// called in the derived class destructor, as the worker still uses its virtual functions
+    void ReleaseSession();
+
+    /// @brief Process one item of this session
+    /// @param item Item to process
+    virtual void Consume(LogItem& item) = 0;
+    /// @brief Called at the end of each batch of records processed since the last flush,
+    /// and every LOG_IDLE_CHECK_INTERVAL if the session doesn't receive any record
+    virtual void OnBatchEnd();
+    /// @brief Write the data buffered by Consume
+    virtual void Flush();
+    /// @brief Called once after the last processed item of this session
+    virtual void OnClose() = 0;
+
+private:
+    friend class LoggingEngine;
+
+    /// @brief Unique id of this session, used to spread the sessions over the workers
+    unsigned int session_id;
+    size_t worker_index;
+    bool opened;
+    std::atomic<bool> close_requested;
+
+    /// @brief Only used by the worker
+    bool closed;
+    bool pending_flush;
+
+    std::mutex released_mutex;
+    std::condition_variable released_condition;
+    bool released;
+};
+
+/// @brief Process-wide logging backend. A small fixed pool of workers processes
+/// the records of all the sessions, writes their files and watches the conf file
+/// changes once for everyone
+class LoggingEngine
+{
+public:
+    static LoggingEngine& GetInstance();
+
+    /// @brief Create a new session owned by a std::shared_ptr. When the last reference is dropped,
+    /// the session is destroyed by a dedicated thread of the engine, as waiting for its worker
+    /// and finalizing its files can take a while. It's then safe to drop it from a network thread
+    /// @tparam T Type of the session, derived from LogSession
+    /// @param args Arguments forwarded to T constructor
+    /// @return The new session
+    template<typename T, typename... Args>
+    static std::shared_ptr<T> MakeSession(Args&&... args)
+    {
+        return std::shared_ptr<T>(new T(std::forward<Args>(args)...), [](T* session) { GetInstance().Retire(session); });
+    }
+
+    /// @brief Get a counter incremented everytime a change of the conf file is detected
+    unsigned int GetConfGeneration() const;
+
+private:
+    LoggingEngine();
+    ~LoggingEngine();
+
+    friend class LogSession;
+
+    enum class RecordType
+    {
+        Open,
+        Item,
+        Close,
+        Release
+    };
+
+    struct Record
+    {
+        LogSession* session;
+        RecordType type;
+        LogItem item;
+    };
+
+    struct Worker
+    {
+        Worker();
+
+        MPSCQueue<Record> queue;
+        std::thread thread;
+        /// @brief Sessions with items processed since the last flush
+        std::vector<LogSession*> active_sessions;
+        /// @brief All the sessions of this worker not closed yet
+        std::vector<LogSession*> open_sessions;
+    };
+
+    void Register(LogSession& session);
+    void Push(LogSession& session, const RecordType type, LogItem&& item);
+    void Wake(const LogSession& session);
+    void Work(Worker& worker);
+    void CloseSession(Worker& worker, LogSession& session);
+    void FlushSessions(Worker& worker);
+    /// @brief Check the conf file and call OnBatchEnd for the open sessions without any record in the last batch
+    void CheckIdleSessions(Worker& worker);
+    /// @brief Check if the conf file has changed, at most every 5 seconds for all the workers
+    void PollConfFile();
+    /// @brief Give a session to the reaper thread to destroy it, never blocks
+    /// @param session Session to destroy
+    void Retire(LogSession* session);
+    /// @brief Destroy the retired sessions until the engine is stopped and none is left
+    void Reap();
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> is_running;
+    std::atomic<unsigned int> next_session_id;
+
+    std::atomic<unsigned int> conf_generation;
+    std::atomic<std::time_t> last_time_checked_conf_file;
+    std::atomic<std::time_t> last_time_conf_file_modified;
+
+    /// @brief Sessions waiting to be destroyed by reaper_thread
+    std::vector<LogSession*> retired_sessions;
+    std::mutex retired_mutex;
+    std::condition_variable retired_condition;
+    bool reaper_running;
+    std::thread reaper_thread;
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief A bounded multiple producers single consumer queue with preallocated
+/// slots. Producers never lock, they only compete for the next slot with a CAS.
+/// The consumer takes everything available at once, and is only woken up by
+/// the producers when it's parked waiting for new items. Each slot has a sequence
+/// number telling if it's free for the producers or ready for the consumer
+template <typename T>
+class MPSCQueue
+{
+public:
+    /// @brief Create a new queue
+    /// @param capacity Number of slots, must be a power of two
+    MPSCQueue(const size_t capacity) :
+        slots(std::make_unique<Slot[]>(capacity)),
+        mask(capacity - 1)
+    {
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_position.store(0, std::memory_order_relaxed);
+        dequeue_position = 0;
+        consumer_parked = false;
+    }
+
+    /// @brief Producer side, add an item at the end of the queue, waiting for some space if it's full.
+    /// WakeConsumer must be called after one or several Push for the consumer to see them
+    /// @param item Item to add
+    void Push(T&& item)
+    {
+        while (!TryPush(std::move(item)))
+        {
+            // The consumer is busy and will make some space soon
+            WakeConsumer();
+            std::this_thread::yield();
+        }
+    }
+
+    /// @brief Producer side, wake the consumer up if it's parked waiting for new items.
+    /// Only locks if it's the case
+    void WakeConsumer()
+    {
+        // Pairs with the fence in WaitForItems, either the consumer
+        // sees the new items or we see it's parked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_parked.load(std::memory_order_relaxed))
+        {
+            {
+                std::lock_guard<std::mutex> lock(park_mutex);
+                consumer_parked = false;
+            }
+            park_condition.notify_one();
+        }
+    }
+
+    /// @brief Wake the consumer up even if there is no new item, after changing running
+    void Interrupt()
+    {
+        {
+            // Make sure the consumer is either waiting or will see the new value before waiting
+            std::lock_guard<std::mutex> lock(park_mutex);
+            consumer_parked = false;
+        }
+        park_condition.notify_all();
+    }
+
+    /// @brief Consumer side, park until there are some items, running is false or timeout is elapsed
+    /// @param running Flag checked before parking, Interrupt must be called after changing it
+    /// @param timeout Max duration to stay parked
+    /// @return False if the timeout elapsed without being woken up
+    bool WaitForItems(const std::atomic<bool>& running, const std::chrono::steady_clock::duration timeout)
+    {
+        std::unique_lock<std::mutex> lock(park_mutex);
+        consumer_parked = true;
+        // Pairs with the fence in WakeConsumer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool woken_up = true;
+        if (Empty() && running)
+        {
+            woken_up = park_condition.wait_for(lock, timeout, [this, &running]() { return !consumer_parked || !running; });
+        }
+        consumer_parked = false;
+        return woken_up;
+    }
+
+    /// @brief Producer side, add an item at the end of the queue if there is some space
+    /// @param item Item to add, left untouched if the queue is full
+    /// @return False if the queue is full
+    bool TryPush(T&& item)
+    {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot& slot = slots[position & mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            // Slot is free, try to claim it
+            if (diff == 0)
+            {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(item);
+                    // Publish it to the consumer
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            // Slot still holds an item from the previous lap, queue is full
+            else if (diff < 0)
+            {
+                return false;
+            }
+            // Another producer claimed this slot, retry with the next one
+            else
+            {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief Consumer side, move all the items available at the end of output
+    /// @param output Vector to append the items to
+    /// @return The number of items moved
+    size_t PopAll(std::vector<T>& output)
+    {
+        size_t count = 0;
+        while (true)
+        {
+            Slot& slot = slots[dequeue_position & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeue_position + 1)
+            {
+                return count;
+            }
+            output.push_back(std::move(slot.value));
+            // Give the slot back to the producers for the next lap
+            slot.sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+            dequeue_position += 1;
+            count += 1;
+        }
+    }
+
+    /// @brief Consumer side, check if there is no item ready
+    bool Empty() const
+    {
+        return slots[dequeue_position & mask].sequence.load(std::memory_order_acquire) != dequeue_position + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    const size_t mask;
+    /// @brief Producers and consumer positions on different cache lines
+    alignas(64) std::atomic<size_t> enqueue_position;
+    alignas(64) size_t dequeue_position;
+
+    /// @brief Only used to park the consumer when the queue is empty, never by producers otherwise
+    std::mutex park_mutex;
+    std::condition_variable park_condition;
+    std::atomic<bool> consumer_parked;
+};
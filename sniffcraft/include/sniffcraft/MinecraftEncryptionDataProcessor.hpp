@@ -1,25 +1,38 @@
 #pragma once
 
 #ifdef USE_ENCRYPTION
-#include <memory>
+#include <array>
+#include <vector>
 
 #include "sniffcraft/DataProcessor.hpp"
 
-namespace Botcraft
-{
-	class AESEncrypter;
-}
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+/// @brief Number of bytes decrypted with one batch of AES block encryptions
+constexpr size_t DECRYPTION_BATCH_SIZE = 512;
 
 class MinecraftEncryptionDataProcessor : public DataProcessor
 {
 public:
-	MinecraftEncryptionDataProcessor(std::unique_ptr<Botcraft::AESEncrypter>& encrypter_);
+	/// @brief Create AES-128-CFB8 encryption and decryption contexts
+	/// @param shared_secret Secret shared with the server, used as both key and IV
+	MinecraftEncryptionDataProcessor(const std::vector<unsigned char>& shared_secret);
 	virtual ~MinecraftEncryptionDataProcessor();
 
-	virtual std::vector<unsigned char> ProcessIncomingData(const std::vector<unsigned char>& data) const override;
-	virtual std::vector<unsigned char> ProcessOutgoingData(const std::vector<unsigned char>& data) const override;
+	virtual void ProcessIncomingData(unsigned char* const data, const size_t length) override;
+	virtual void ProcessOutgoingData(unsigned char* const data, const size_t length) override;
 
 private:
-	std::unique_ptr<Botcraft::AESEncrypter> encrypter;
+	/// @brief AES-128-CFB8 context, encryption is serial as each byte depends on the previous output
+	EVP_CIPHER_CTX* encryption_context;
+	/// @brief AES-128-ECB context used to compute CFB8 decryption keystream. As all
+	/// the ciphertext is already known, keystream blocks can be computed in parallel
+	EVP_CIPHER_CTX* decryption_context;
+	/// @brief Last 16 bytes of ciphertext received (IV at start), followed by the current batch ciphertext
+	std::array<unsigned char, 16 + DECRYPTION_BATCH_SIZE> decryption_ciphertext;
+	/// @brief One 16 bytes CFB8 shift register state per byte of the batch
+	std::vector<unsigned char> decryption_registers;
+	/// @brief AES encryption of each decryption_registers block
+	std::vector<unsigned char> decryption_keystream;
 };
-#endif
\ No newline at end of file
+#endif
@@ -1,9 +1,20 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include <protocolCraft/Handler.hpp>
 #include <protocolCraft/enums.hpp>
 
 #include "sniffcraft/BaseProxy.hpp"
+#include "sniffcraft/BufferPool.hpp"
+#include "sniffcraft/Framing.hpp"
 
 #ifdef USE_ENCRYPTION
 #if PROTOCOL_VERSION > 760 /* > 1.19.1/2 */
@@ -15,11 +26,54 @@ namespace Botcraft
 }
 #endif
 
+class Compressor;
+class Decompressor;
 class Logger;
 class ReplayModLogger;
 
+/// @brief Maximum duration of the Microsoft authentication, can require the user to log in
+constexpr std::chrono::minutes AUTHENTICATION_TIMEOUT = std::chrono::minutes(5);
+/// @brief Maximum uncompressed size of a packet data allowed by the protocol
+constexpr int MAX_PACKET_DATA_LENGTH = 8 * 1024 * 1024;
+
 class MinecraftProxy : public BaseProxy, public ProtocolCraft::Handler
 {
+private:
+    /// @brief A packet forwarded while it's still being received
+    struct CutThroughPacket
+    {
+        /// @brief Bytes of the packet not forwarded yet, 0 if no packet is being cut through
+        size_t remaining_bytes = 0;
+        /// @brief Number of bytes before the packet id (packet and data lengths)
+        size_t header_size;
+        ProtocolCraft::ConnectionState connection_state;
+        /// @brief Size of the uncompressed packet data, 0 if not compressed
+        int data_length;
+        /// @brief If true, bytes are kept to parse and log the packet once complete
+        bool parse;
+        /// @brief Bytes of the packet already forwarded, including the packet length
+        PooledBuffer bytes;
+    };
+
+    /// @brief A packet waiting to be logged with the rest of its batch
+    struct PendingLog
+    {
+        /// @brief Parsed packet, nullptr if it still has to be parsed from bytes
+        std::shared_ptr<ProtocolCraft::Packet> packet;
+        /// @brief Packet bytes including the packet length, only used if packet is nullptr
+        PooledBuffer bytes;
+        /// @brief Number of bytes before the packet id in bytes
+        size_t header_size;
+        /// @brief Size of the uncompressed packet data, 0 if not compressed
+        int data_length;
+        std::chrono::system_clock::time_point date;
+        ProtocolCraft::ConnectionState connection_state;
+        Endpoint origin;
+        size_t bandwidth_bytes;
+        /// @brief If true, also log it with the replay logger
+        bool replay;
+    };
+
 public:
     MinecraftProxy(
         asio::io_context& io_context,
@@ -27,24 +81,90 @@ public:
     );
     virtual ~MinecraftProxy();
 
-    virtual std::optional<std::string> Start(const std::string& server_address, const unsigned short server_port) override;
+    virtual void Start(const std::string& server_address, const unsigned short server_port, const std::function<void(const std::optional<std::string>&)>& callback) override;
 
     std::shared_ptr<Logger> GetLogger() const;
 
 protected:
     virtual size_t ProcessData(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source) override;
 
+    virtual void OnServerConnected(const std::function<void(const std::optional<std::string>&)>& done) override;
+
 private:
-    /// @brief Check the size of the next MC packet
+    /// @brief Forward, parse and handle one complete packet
+    /// @param data iterator to the packet start, including the packet length
+    /// @param frame Sizes of the packet
+    /// @param source Where the packet is coming from
+    void ProcessPacket(const std::vector<unsigned char>::const_iterator& data, const Frame& frame, const Endpoint source);
+
+    /// @brief Start forwarding an incomplete packet if it's big enough and not handled by this proxy
+    /// @param data iterator to the data start, including the packet length
+    /// @param length number of available bytes
+    /// @param packet_size Total size of the packet, including the packet length
+    /// @param source Where the packet is coming from
+    /// @return The number of bytes forwarded, 0 if the packet has to be fully received first
+    size_t StartCutThrough(const std::vector<unsigned char>::const_iterator& data, const size_t length, const size_t packet_size, const Endpoint source);
+
+    /// @brief Forward the next bytes of the packet currently cut through, and log it once complete
     /// @param data iterator to the data start
     /// @param length number of available bytes
-    /// @return The size of the next packet, or 0 if not enough bytes to read the size
-    size_t Peek(std::vector<unsigned char>::const_iterator& data, size_t& length);
+    /// @param source Where the packet is coming from
+    /// @return The number of bytes forwarded
+    size_t ContinueCutThrough(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source);
+
+    /// @brief Add a packet that has already been forwarded to the pending logs, it's parsed when the logs are flushed
+    /// @param bytes Packet bytes, including the packet length
+    /// @param header_size Number of bytes before the packet id (packet and data lengths)
+    /// @param data_length Size of the uncompressed packet data, 0 if not compressed
+    /// @param packet_connection_state Connection state of the packet
+    /// @param source Where the packet is coming from
+    void ParseAndLog(PooledBuffer&& bytes, const size_t header_size, const int data_length, const ProtocolCraft::ConnectionState packet_connection_state, const Endpoint source);
+
+    /// @brief Add a packet to the pending logs of a lane
+    /// @param lane Endpoint of the lane processing the packet, not always its origin
+    /// @param packet Packet to log
+    /// @param connection_state Connection state of the packet
+    /// @param origin Where the packet is coming from
+    /// @param bandwidth_bytes Size of the packet on the network
+    /// @param replay If true, also log it with the replay logger
+    void LogPacket(const Endpoint lane, const std::shared_ptr<ProtocolCraft::Packet>& packet, const ProtocolCraft::ConnectionState connection_state, const Endpoint origin, const size_t bandwidth_bytes, const bool replay = false);
+
+    /// @brief Send all the pending logs of a lane to the loggers at once. In forward
+    /// first mode, it's done later on the parsing strand, keeping the packets order
+    /// @param lane Endpoint of the lane to flush the logs of
+    void FlushPendingLogs(const Endpoint lane);
+
+    /// @brief Check a data length read from a packet before using it to decompress anything
+    /// @param data_length Size of the uncompressed packet data as sent by the peer, 0 if not compressed
+    /// @param threshold Current compression threshold
+    /// @return True if data_length is 0, or between threshold and MAX_PACKET_DATA_LENGTH
+    static bool IsValidDataLength(const int data_length, const int threshold);
+
+    /// @brief Decompress and parse a packet
+    /// @param data iterator to the packet data, after the packet and data lengths
+    /// @param length number of bytes of the packet data
+    /// @param data_length Size of the uncompressed packet data, 0 if not compressed
+    /// @param packet_connection_state Connection state of the packet
+    /// @param source Where the packet is coming from
+    /// @param decompressor Decompressor to use, only used by the current thread
+    /// @return The parsed packet, nullptr if it can't be parsed
+    static std::shared_ptr<ProtocolCraft::Packet> ParsePacket(std::vector<unsigned char>::const_iterator data, size_t length, const int data_length, const ProtocolCraft::ConnectionState packet_connection_state, const Endpoint source, Decompressor& decompressor);
 
     /// @brief Convert a MC packet to bytes vector
     /// @param packet Packet to convert
     /// @return Bytes representation of the packet
-    std::vector<unsigned char> PacketToBytes(const ProtocolCraft::Packet& packet) const;
+    PooledBuffer PacketToBytes(const ProtocolCraft::Packet& packet);
+
+    /// @brief Rebuild the parsing needed tables of one source from the handled packets and the loggers current configuration
+    /// @param source Endpoint to rebuild the tables of, only called from this endpoint lane
+    void UpdateParsingNeeded(const Endpoint source);
+
+    /// @brief Check if a packet has to be parsed or if it can directly be transmitted
+    /// @param connection_state Connection state of the packet
+    /// @param source Where the packet is coming from
+    /// @param packet_id ID of the packet
+    /// @return True if the packet is handled by this proxy or used by any logger, false otherwise
+    bool IsParsingNeeded(const ProtocolCraft::ConnectionState connection_state, const Endpoint source, const int packet_id) const;
 
     virtual void Handle(ProtocolCraft::ServerboundClientIntentionPacket& packet) override;
     virtual void Handle(ProtocolCraft::ServerboundHelloPacket& packet) override;
@@ -73,6 +193,37 @@ private:
     virtual void Handle(ProtocolCraft::ClientboundTransferPacket& packet) override;
 #endif
 
+    /// @brief True if PacketType has a Handle override in this class. Handle declarations
+    /// here hide the base ones, so the cast only resolves if there is an override
+    template <typename PacketType, typename = void>
+    struct HasHandleOverride : std::false_type {};
+    template <typename PacketType>
+    struct HasHandleOverride<PacketType, std::void_t<decltype(static_cast<void (MinecraftProxy::*)(PacketType&)>(&MinecraftProxy::Handle))>> : std::true_type {};
+
+    /// @brief Get the ids of all the packets of a tuple with a Handle override
+    template <typename PacketsTuple, size_t... Indices>
+    static std::set<int> GetHandledIds(std::index_sequence<Indices...>);
+    template <typename PacketsTuple>
+    static std::set<int> GetHandledIds();
+
+    /// @brief Get all the packets with a Handle override, built from the overrides
+    /// themselves so a new handler can't be forgotten
+    /// @return A set of packet ids for each (connection state, source)
+    static const std::map<std::pair<ProtocolCraft::ConnectionState, Endpoint>, std::set<int>>& GetHandledPackets();
+
+    /// @brief Check if a packet has a Handle override in this class
+    /// @param connection_state Connection state of the packet
+    /// @param source Where the packet is coming from
+    /// @param packet_id ID of the packet
+    /// @return True if the packet is handled
+    static bool IsHandledPacket(const ProtocolCraft::ConnectionState connection_state, const Endpoint source, const int packet_id);
+
+    /// @brief Check if any packet has a Handle override for a connection state and source
+    /// @param connection_state Connection state to check
+    /// @param source Where the packets are coming from
+    /// @return True if at least one packet is handled
+    static bool HasHandledPackets(const ProtocolCraft::ConnectionState connection_state, const Endpoint source);
+
 private:
 #if PROTOCOL_VERSION > 765 /* > 1.20.4 */
     // Hostname and port the real client used to connect to sniffcraft
@@ -84,14 +235,70 @@ private:
 #endif
 
     std::shared_ptr<Logger> logger;
-    std::unique_ptr<ReplayModLogger> replay_logger;
+    std::shared_ptr<ReplayModLogger> replay_logger;
+
+    /// @brief For each connection state, a table indexed by serverbound packet id, false if
+    /// the packet can be transmitted without parsing. Empty table if all packets are needed.
+    /// Only used by the client lane
+    std::map<ProtocolCraft::ConnectionState, std::vector<bool>> client_parsing_needed;
+    /// @brief Logger configuration version used to build client_parsing_needed
+    unsigned int client_parsing_needed_conf_version;
+    /// @brief Same as client_parsing_needed for clientbound packets, only used by the server lane
+    std::map<ProtocolCraft::ConnectionState, std::vector<bool>> server_parsing_needed;
+    /// @brief Logger configuration version used to build server_parsing_needed
+    unsigned int server_parsing_needed_conf_version;
+
+    /// @brief The only state shared by both processing lanes. Only modified by the handlers
+    /// of the state transition packets, before the packet is forwarded. As the other endpoint
+    /// can't send anything in the new state before receiving it, the other lane always sees the
+    /// new value before processing any packet depending on it
+    std::atomic<ProtocolCraft::ConnectionState> connection_state;
+    std::atomic<int> compression_threshold;
+    /// @brief Set to false by the clientbound packets handlers if the packet is replaced
+    bool transmit_original_clientbound_packet;
+    /// @brief Set to false by the serverbound packets handlers if the packet is replaced
+    bool transmit_original_serverbound_packet;
+
+    /// @brief Minimum size of a packet to forward it before being fully received, 0 to disable
+    size_t cut_through_threshold;
+    /// @brief Packet coming from the client currently cut through, only used by the client lane
+    CutThroughPacket client_cut_through;
+    /// @brief Packet coming from the server currently cut through, only used by the server lane
+    CutThroughPacket server_cut_through;
+
+    /// @brief If true, packets without Handle override are forwarded before being parsed and logged
+    bool forward_first;
+    /// @brief Strand parsing and logging the packets of this proxy in forward first mode, keeping their order
+    asio::strand<asio::io_context::executor_type> parsing_strand;
 
-    ProtocolCraft::ConnectionState connection_state;
-    bool transmit_original_packet;
-    int compression_threshold;
+    /// @brief Complete packets found in the data from the client, only used by the client lane
+    std::vector<Frame> client_frames;
+    /// @brief Complete packets found in the data from the server, only used by the server lane
+    std::vector<Frame> server_frames;
+    /// @brief Inflate stream for the packets parsed by the client lane
+    std::shared_ptr<Decompressor> client_decompressor;
+    /// @brief Inflate stream for the packets parsed by the server lane
+    std::shared_ptr<Decompressor> server_decompressor;
+    /// @brief Inflate stream for the packets parsed on the parsing strand. Shared with
+    /// the tasks posted on it as they can outlive this proxy
+    std::shared_ptr<Decompressor> deferred_decompressor;
+    /// @brief Deflate stream for the packets sent by sniffcraft, level favors speed
+    std::unique_ptr<Compressor> wire_compressor;
+    /// @brief Mutex protecting wire_compressor, as packets can be sent from both lanes
+    std::mutex wire_compressor_mutex;
+    /// @brief Logs of the client lane current batch, only used by the client lane
+    std::vector<PendingLog> client_pending_logs;
+    /// @brief Logs of the server lane current batch, only used by the server lane
+    std::vector<PendingLog> server_pending_logs;
 #ifdef USE_ENCRYPTION
-    std::unique_ptr<Botcraft::Authentifier> authentifier;
+    /// @brief Shared with the detached thread running the blocking authentication, which can outlive this proxy
+    std::shared_ptr<Botcraft::Authentifier> authentifier;
+    /// @brief Key of the Microsoft credentials in the cache
+    std::string credentials_cache_key;
 #if PROTOCOL_VERSION > 760 /* > 1.19.1/2 */
+    /// @brief Mutex protecting chat_context, chat_session_uuid and message_sent_index,
+    /// used by clientbound and serverbound chat packets handlers
+    std::mutex chat_mutex;
     Botcraft::LastSeenMessagesTracker chat_context;
     ProtocolCraft::UUID chat_session_uuid;
     int message_sent_index;
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <protocolCraft/enums.hpp>
+#include <protocolCraft/Packet.hpp>
+
+struct PacketPoolStats
+{
+    /// @brief Number of packets whose memory had to be allocated on the heap
+    size_t heap_allocations = 0;
+    /// @brief Number of packets whose memory was taken back from a released packet of the same type
+    size_t reused_allocations = 0;
+};
+
+/// @brief Create an empty clientbound packet. Its memory (shared with its control
+/// block) is taken from a free list per packet type and given back to it when
+/// the last shared_ptr is released, instead of being allocated and freed each time
+/// @param connection_state Connection state of the packet
+/// @param id Id of the packet
+/// @return The created packet, nullptr if there is no packet with this id
+std::shared_ptr<ProtocolCraft::Packet> CreatePooledClientboundPacket(const ProtocolCraft::ConnectionState connection_state, const int id);
+
+/// @brief Create an empty serverbound packet, see CreatePooledClientboundPacket
+/// @param connection_state Connection state of the packet
+/// @param id Id of the packet
+/// @return The created packet, nullptr if there is no packet with this id
+std::shared_ptr<ProtocolCraft::Packet> CreatePooledServerboundPacket(const ProtocolCraft::ConnectionState connection_state, const int id);
+
+/// @brief Get the allocation counters of all the packet pools since program start
+PacketPoolStats GetPacketPoolStats();
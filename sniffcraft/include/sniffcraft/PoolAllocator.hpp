@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/// @brief Released memory blocks for one type, kept to be reused by the next allocations.
+/// Each thread caches a few blocks it can acquire and release without any lock, the
+/// shared list behind the mutex is only used when this cache is empty or full
+template <typename T>
+class FreeList
+{
+public:
+    /// @brief Max number of released blocks kept in the shared list, above that they are given back to the heap
+    static constexpr size_t max_free_blocks = 256;
+    /// @brief Max number of released blocks cached by each thread
+    static constexpr size_t max_thread_blocks = 16;
+
+    static FreeList& GetInstance()
+    {
+        // Never destroyed, blocks can still be released during static destruction
+        static FreeList* instance = new FreeList();
+        return *instance;
+    }
+
+    T* Acquire()
+    {
+        if (!thread_cache_destroyed)
+        {
+            std::vector<T*>& cached = thread_cache.blocks;
+            if (!cached.empty())
+            {
+                T* block = cached.back();
+                cached.pop_back();
+                return block;
+            }
+        }
+
+        std::scoped_lock<std::mutex> lock(mutex);
+        if (blocks.empty())
+        {
+            return nullptr;
+        }
+        T* block = blocks.back();
+        blocks.pop_back();
+        return block;
+    }
+
+    bool Release(T* block)
+    {
+        if (!thread_cache_destroyed && thread_cache.blocks.size() < max_thread_blocks)
+        {
+            thread_cache.blocks.push_back(block);
+            return true;
+        }
+
+        return ReleaseShared(block);
+    }
+
+private:
+    FreeList()
+    {
+        blocks.reserve(max_free_blocks);
+    }
+
+    bool ReleaseShared(T* block)
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        if (blocks.size() >= max_free_blocks)
+        {
+            return false;
+        }
+        blocks.push_back(block);
+        return true;
+    }
+
+    /// @brief Blocks cached by a thread, given to the shared list when the thread exits
+    struct ThreadCache
+    {
+        ThreadCache()
+        {
+            blocks.reserve(max_thread_blocks);
+        }
+
+        ~ThreadCache()
+        {
+            thread_cache_destroyed = true;
+            for (T* block : blocks)
+            {
+                if (!GetInstance().ReleaseShared(block))
+                {
+                    ::operator delete(block);
+                }
+            }
+        }
+
+        std::vector<T*> blocks;
+    };
+
+private:
+    std::mutex mutex;
+    std::vector<T*> blocks;
+
+    static inline thread_local ThreadCache thread_cache;
+    /// @brief Set when the thread cache is destroyed, blocks released after that go to the shared list
+    static inline thread_local bool thread_cache_destroyed = false;
+};
+
+/// @brief Allocator recycling single object allocations through a FreeList.
+/// Meant to be used with std::allocate_shared or shared_ptr custom deleter
+/// constructors: it's rebound by the standard library to the type holding the
+/// control block, so there is one free list per shared type and one block per object.
+/// @tparam Counters Type with static heap_allocations and reused_allocations atomic counters
+template <typename T, typename Counters>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, Counters>&)
+    {
+
+    }
+
+    T* allocate(const size_t n)
+    {
+        if (n == 1)
+        {
+            T* block = FreeList<T>::GetInstance().Acquire();
+            if (block != nullptr)
+            {
+                Counters::reused_allocations.fetch_add(1, std::memory_order_relaxed);
+                return block;
+            }
+        }
+        Counters::heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* block, const size_t n)
+    {
+        if (n == 1 && FreeList<T>::GetInstance().Release(block))
+        {
+            return;
+        }
+        ::operator delete(block);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U, Counters>&) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U, Counters>&) const
+    {
+        return false;
+    }
+};
@@ -2,44 +2,39 @@
 
 #include "sniffcraft/enums.hpp"
 #include "sniffcraft/LogItem.hpp"
+#include "sniffcraft/LoggingEngine.hpp"
 
 #include <protocolCraft/enums.hpp>
 #include <protocolCraft/Packet.hpp>
 
-#include <thread>
-#include <mutex>
 #include <fstream>
 #include <memory>
-#include <queue>
 #include <chrono>
 #include <set>
 #include <ctime>
-#include <condition_variable>
 
-class ReplayModLogger
+/// @brief Replay recording of one connection, its packets are written by the LoggingEngine workers
+class ReplayModLogger : public LogSession
 {
 public:
     ReplayModLogger();
-    ~ReplayModLogger();
+    virtual ~ReplayModLogger();
     void Log(const std::shared_ptr<ProtocolCraft::Packet> packet, const ProtocolCraft::ConnectionState connection_state, const Endpoint origin);
     void SetServerName(const std::string& server_name_);
 
+protected:
+    virtual void Consume(LogItem& item) override;
+    virtual void OnClose() override;
+
 private:
-    void LogConsume();
     void SaveReplayMetadataFile() const;
     void WrapMCPRFile() const;
 
 private:
     std::chrono::time_point<std::chrono::system_clock> start_time;
 
-    std::thread log_thread;
-    std::mutex log_mutex;
-    std::condition_variable log_condition;
-    std::queue<LogItem> logging_queue;
-
     std::string session_prefix;
     std::ofstream replay_file;
-    bool is_running;
 
     std::string server_name;
 };
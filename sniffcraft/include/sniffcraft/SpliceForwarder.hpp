@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <asio.hpp>
+
+#include "sniffcraft/Connection.hpp"
+
+/// @brief Maximum number of bytes moved by one splice call
+constexpr size_t SPLICE_CHUNK_SIZE = 64 * 1024;
+
+/// @brief Forward all the bytes from one socket to another in one direction,
+/// using splice to move them through a pipe without copying them in userspace.
+/// When the source is closed, everything already received is forwarded before
+/// closing the sending side of the destination, the other direction keeps going.
+/// Only supported on Linux. All the handlers run on the source socket executor
+class SpliceForwarder
+{
+public:
+    /// @brief Create a forwarder, nothing is done until Prepare and Start are called
+    /// @param src Connection to read from, its activity is updated on every read
+    /// @param dst Connection to write to
+    /// @param owner Object owning both connections, kept alive by every pending handler
+    /// @param on_stop Function called when the forwarding stops, once the source is closed and everything has been forwarded, or on error
+    SpliceForwarder(Connection& src, Connection& dst, const std::weak_ptr<void>& owner, const std::function<void()>& on_stop);
+    ~SpliceForwarder();
+
+    /// @brief Check if splice forwarding can be used on this platform
+    /// @return True if supported, false otherwise
+    static bool IsSupported();
+
+    /// @brief Create the pipe and set the sockets in non blocking mode
+    /// @return An error message if the forwarding can't be used
+    std::optional<std::string> Prepare();
+
+    /// @brief Start forwarding data, Prepare must have succeeded
+    void Start();
+
+    /// @brief Get the number of bytes forwarded so far
+    /// @return Number of bytes written to the destination socket
+    size_t GetTransferredBytes() const;
+
+    /// @brief Check if this forwarder is done
+    /// @return True if the forwarding stopped, either cleanly or because of an error
+    bool Stopped() const;
+
+    /// @brief Check if this forwarder stopped because of an error
+    /// @return True if an error occured, false if still running or if the source was closed cleanly
+    bool Failed() const;
+
+private:
+    /// @brief Move as much data as possible from src to dst, then wait for the blocking side
+    void Transfer();
+    void handle_ready(const asio::error_code& ec);
+    /// @brief Stop forwarding and call on_stop
+    /// @param error True if stopped because of an error
+    void Stop(const bool error);
+
+private:
+    Connection& src;
+    Connection& dst;
+    std::weak_ptr<void> owner;
+    std::function<void()> on_stop;
+
+    /// @brief Read and write ends of the pipe
+    int pipe_fds[2];
+    /// @brief Bytes spliced into the pipe but not yet into dst
+    size_t bytes_in_pipe;
+    std::atomic<size_t> transferred_bytes;
+    /// @brief True once the source has been closed, the pipe still has to be emptied
+    bool source_closed;
+    bool stopped;
+    bool failed;
+};
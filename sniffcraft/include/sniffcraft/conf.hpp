@@ -22,6 +22,17 @@ public:
     static const std::string online_key;
     static const std::string network_recap_to_console_key;
     static const std::string account_cache_key_key;
+    static const std::string max_read_buffer_size_key;
+    static const std::string network_threads_key;
+    static const std::string raw_forwarding_key;
+    static const std::string write_high_watermark_key;
+    static const std::string write_low_watermark_key;
+    static const std::string idle_timeout_key;
+    static const std::string cut_through_threshold_key;
+    static const std::string forward_first_key;
+    static const std::string wire_compression_level_key;
+    static const std::string capture_compression_level_key;
+    static const std::string logging_threads_key;
     static const std::string handshaking_key;
     static const std::string status_key;
     static const std::string login_key;
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
@@ -25,11 +27,14 @@ public:
 private:
     void run_iocontext();
     void listen_connection();
-    void handle_accept(BaseProxy* new_proxy, const asio::error_code &ec);
+    void handle_accept(const std::shared_ptr<BaseProxy>& new_proxy, const asio::error_code &ec);
+    /// @brief Called on the proxy strand once its start sequence is done
+    void handle_proxy_started(BaseProxy* proxy, const std::optional<std::string>& error);
     void ResolveIpPortFromAddress();
     void PrepareForTransfer(const std::string& new_ip, const int new_port);
 
-    BaseProxy* GetNewMinecraftProxy();
+    /// @brief Create a new proxy, a MinecraftProxy or a raw forwarding BaseProxy depending on the conf
+    std::shared_ptr<BaseProxy> GetNewProxy();
     void CleanProxies();
 
 #ifdef WITH_GUI
@@ -43,17 +48,31 @@ private:
     unsigned short server_port;
     unsigned short client_port;
 
+    /// @brief Protect transfer infos, as they are set from a proxy
+    /// strand and read when accepting a new connection
+    std::mutex transfer_mutex;
     bool is_next_connection_transfer;
     std::string transfer_ip;
     unsigned short transfer_port;
 
+    /// @brief If true, create raw forwarding proxies instead of MinecraftProxy, nothing is parsed nor logged
+    bool raw_forwarding;
+
+    /// @brief Number of threads running io_context
+    unsigned int network_threads_count;
     asio::io_context io_context;
+    /// @brief Additional threads running io_context, shared by all the proxies
+    std::vector<std::thread> iocontext_threads;
     std::unique_ptr<asio::ip::tcp::acceptor> acceptor;
 
-    std::vector<std::unique_ptr<BaseProxy>> proxies;
+    /// @brief Proxies are shared with their pending handlers, removing one
+    /// from here only destroys it once nothing can run on it anymore
+    std::vector<std::shared_ptr<BaseProxy>> proxies;
     std::mutex proxies_mutex;
     std::thread proxies_cleaning_thread;
     std::atomic<bool> proxies_cleaning_thread_running;
+    /// @brief Proxies that didn't receive anything for this duration are closed by the cleaning thread
+    std::chrono::seconds idle_timeout;
 
 #ifdef WITH_GUI
     std::thread iocontext_thread;
@@ -2,99 +2,243 @@
 
 #include <iostream>
 
-BaseProxy::BaseProxy(asio::io_context& io_context) :
-    io_context_(io_context),
-    client_connection(io_context),
-    server_connection(io_context)
+BaseProxy::BaseProxy(asio::io_context& io_context, const bool raw_forwarding) :
+    strand(asio::make_strand(io_context)),
+    client_lane(asio::make_strand(io_context)),
+    server_lane(asio::make_strand(io_context)),
+    client_connection(strand),
+    server_connection(strand),
+    resolver(strand),
+    start_timer(strand),
+    raw_forwarding(raw_forwarding),
+    client_lane_timer(client_lane),
+    server_lane_timer(server_lane)
 {
     started = false;
     closed = true;
+    client_processing_scheduled = false;
+    server_processing_scheduled = false;
+    client_spilled_data = std::make_shared<std::vector<unsigned char>>();
+    server_spilled_data = std::make_shared<std::vector<unsigned char>>();
+    client_spilled_data_start = 0;
+    server_spilled_data_start = 0;
+    client_lane_paused = false;
+    server_lane_paused = false;
 }
 
 BaseProxy::~BaseProxy()
 {
     Close();
-    data_source_cv.notify_one();
-    if (data_processing_thread.joinable())
-    {
-        data_processing_thread.join();
-    }
 }
 
-std::optional<std::string> BaseProxy::Start(const std::string& server_address, const unsigned short server_port)
+void BaseProxy::Start(const std::string& server_address, const unsigned short server_port, const std::function<void(const std::optional<std::string>&)>& callback)
 {
     std::cout << "Starting new proxy to " << server_address << ":" << server_port << std::endl;
     server_ip_ = server_address;
     server_port_ = server_port;
 
-    // Try to connect to remote server
-    asio::ip::tcp::resolver resolver(io_context_);
-    asio::error_code ec;
-    asio::ip::tcp::resolver::results_type results = resolver.resolve(server_ip_, std::to_string(server_port_), ec);
+    // Handlers of the connections keep this proxy alive until they are done
+    client_connection.SetOwner(weak_from_this());
+    server_connection.SetOwner(weak_from_this());
+
+    // Run the whole start sequence on the strand, so it's never
+    // executed concurrently with any of this proxy handlers
+    asio::dispatch(strand, [this, self = shared_from_this(), callback]() {
+        start_callback = callback;
+        start_time = std::chrono::steady_clock::now();
+        closed = false;
+        started = true;
+
+        BeginStartStage("address resolution", UPSTREAM_CONNECT_TIMEOUT);
+        resolver.async_resolve(server_ip_, std::to_string(server_port_),
+            std::bind(&BaseProxy::handle_resolve, shared_from_this(),
+                std::placeholders::_1, std::placeholders::_2));
+    });
+}
 
-    if (ec)
+void BaseProxy::OnServerConnected(const std::function<void(const std::optional<std::string>&)>& done)
+{
+    done(std::nullopt);
+}
+
+void BaseProxy::BeginStartStage(const std::string& stage, const std::chrono::steady_clock::duration timeout)
+{
+    EndStartStage();
+    start_stage = stage;
+    start_stage_time = std::chrono::steady_clock::now();
+
+    start_timer.expires_after(timeout);
+    start_timer.async_wait(std::bind(&BaseProxy::handle_start_timeout, shared_from_this(), std::placeholders::_1));
+}
+
+void BaseProxy::EndStartStage()
+{
+    if (start_stage.empty())
     {
-        Close();
-        return "Error resolving address " + server_address + ":" + std::to_string(server_port) + ": " + ec.message();
+        return;
     }
+    std::cout << "Proxy to " << server_ip_ << ":" << server_port_ << ", " << start_stage << " done in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_stage_time).count() << " ms" << std::endl;
+    start_stage.clear();
+}
 
-    asio::connect(server_connection.GetSocket(), results, ec);
-    if (ec)
+void BaseProxy::handle_resolve(const asio::error_code& ec, const asio::ip::tcp::resolver::results_type& results)
+{
+    // Already aborted
+    if (!start_callback)
     {
-        Close();
-        return "Error trying to establish connection to " + server_address + ":" + std::to_string(server_port) + ": " + ec.message();
+        return;
     }
 
-    server_connection.GetSocket().set_option(asio::ip::tcp::no_delay(true), ec);
     if (ec)
     {
-        return "Error enabling TCP_NODELAY on the server connection: " + ec.message();
+        FinishStart("Error resolving address " + server_ip_ + ":" + std::to_string(server_port_) + ": " + ec.message());
+        return;
+    }
+
+    BeginStartStage("connection", UPSTREAM_CONNECT_TIMEOUT);
+    asio::async_connect(server_connection.GetSocket(), results,
+        std::bind(&BaseProxy::handle_connect, shared_from_this(),
+            std::placeholders::_1, std::placeholders::_2));
+}
+
+void BaseProxy::handle_connect(const asio::error_code& ec, const asio::ip::tcp::endpoint&)
+{
+    if (!start_callback)
+    {
+        return;
     }
 
-    client_connection.GetSocket().set_option(asio::ip::tcp::no_delay(true), ec);
     if (ec)
     {
-        return "Error enabling TCP_NODELAY on the client connection: " + ec.message();
+        FinishStart("Error trying to establish connection to " + server_ip_ + ":" + std::to_string(server_port_) + ": " + ec.message());
+        return;
     }
 
-    closed = false;
-    started = true;
+    asio::error_code option_ec;
+    server_connection.GetSocket().set_option(asio::ip::tcp::no_delay(true), option_ec);
+    if (option_ec)
+    {
+        FinishStart("Error enabling TCP_NODELAY on the server connection: " + option_ec.message());
+        return;
+    }
+
+    client_connection.GetSocket().set_option(asio::ip::tcp::no_delay(true), option_ec);
+    if (option_ec)
+    {
+        FinishStart("Error enabling TCP_NODELAY on the client connection: " + option_ec.message());
+        return;
+    }
+
+    OnServerConnected(std::bind(&BaseProxy::FinishStart, this, std::placeholders::_1));
+}
+
+void BaseProxy::handle_start_timeout(const asio::error_code& ec)
+{
+    if (ec == asio::error::operation_aborted || !start_callback)
+    {
+        return;
+    }
 
-    // Once connected, we can start the processing thread
-    process_data_ready = false;
-    data_processing_thread = std::thread(&BaseProxy::ReadIncomingData, this);
+    FinishStart("Timeout during " + start_stage + " to " + server_ip_ + ":" + std::to_string(server_port_));
+}
 
-    // Wait for the thread to be launched and ready to process incoming data
-    while (!process_data_ready)
+void BaseProxy::FinishStart(const std::optional<std::string>& error)
+{
+    if (!start_callback)
     {
+        return;
+    }
 
+    const std::function<void(const std::optional<std::string>&)> callback = std::move(start_callback);
+    start_callback = nullptr;
+    start_timer.cancel();
+    resolver.cancel();
+
+    if (error.has_value())
+    {
+        callback(error);
+        Close();
+        return;
     }
 
-    client_connection.SetCallback(
-        std::bind(
-            &BaseProxy::NotifyClientData, this,
-            std::placeholders::_1
-        )
-    );
+    EndStartStage();
+    std::cout << "Proxy to " << server_ip_ << ":" << server_port_ << " started in " <<
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count() << " ms" << std::endl;
+
+    if (raw_forwarding && StartRawForwarding())
+    {
+        callback(std::nullopt);
+        return;
+    }
 
-    server_connection.SetCallback(
-        std::bind(
-            &BaseProxy::NotifyServerData, this,
-            std::placeholders::_1
-        )
-    );
+    // Only called from the connections handlers, which keep this proxy alive
+    client_connection.SetCallback(std::bind(&BaseProxy::NotifyNewData, this, Endpoint::Client));
+    server_connection.SetCallback(std::bind(&BaseProxy::NotifyNewData, this, Endpoint::Server));
+    // When a write queue is drained, resume processing the data going to it
+    client_connection.SetWriteDrainedCallback(std::bind(&BaseProxy::NotifyNewData, this, Endpoint::Server));
+    server_connection.SetWriteDrainedCallback(std::bind(&BaseProxy::NotifyNewData, this, Endpoint::Client));
 
     client_connection.StartListeningAndWriting();
     server_connection.StartListeningAndWriting();
 
-    return std::nullopt;
+    callback(std::nullopt);
+}
+
+bool BaseProxy::StartRawForwarding()
+{
+    if (!SpliceForwarder::IsSupported())
+    {
+        std::cout << "Raw forwarding not supported on this platform, using regular forwarding" << std::endl;
+        return false;
+    }
+
+    // The forwarders handlers keep this proxy alive, on_stop is only called from them
+    client_to_server_forwarder = std::make_unique<SpliceForwarder>(client_connection, server_connection, weak_from_this(), std::bind(&BaseProxy::OnRawForwardingStopped, this));
+    server_to_client_forwarder = std::make_unique<SpliceForwarder>(server_connection, client_connection, weak_from_this(), std::bind(&BaseProxy::OnRawForwardingStopped, this));
+
+    std::optional<std::string> error = client_to_server_forwarder->Prepare();
+    if (!error.has_value())
+    {
+        error = server_to_client_forwarder->Prepare();
+    }
+    if (error.has_value())
+    {
+        std::cerr << error.value() << ", using regular forwarding" << std::endl;
+        client_to_server_forwarder.reset();
+        server_to_client_forwarder.reset();
+        // Go back to the mode expected by the connections
+        asio::error_code ec;
+        client_connection.GetSocket().native_non_blocking(false, ec);
+        server_connection.GetSocket().native_non_blocking(false, ec);
+        return false;
+    }
+
+    client_to_server_forwarder->Start();
+    server_to_client_forwarder->Start();
+    return true;
+}
+
+void BaseProxy::OnRawForwardingStopped()
+{
+    // A cleanly closed direction has already been shut down, the other one can still transfer data
+    if (client_to_server_forwarder->Failed() || server_to_client_forwarder->Failed() ||
+        (client_to_server_forwarder->Stopped() && server_to_client_forwarder->Stopped()))
+    {
+        Close();
+    }
 }
 
 void BaseProxy::Close()
 {
     client_connection.Close();
     server_connection.Close();
-    closed = true;
+    if (!closed.exchange(true) && client_to_server_forwarder != nullptr)
+    {
+        std::cout << "Raw forwarding to " << server_ip_ << ":" << server_port_ << " closed. Client --> Server: "
+            << client_to_server_forwarder->GetTransferredBytes() << " bytes, Server --> Client: "
+            << server_to_client_forwarder->GetTransferredBytes() << " bytes" << std::endl;
+    }
 }
 
 bool BaseProxy::Started()
@@ -104,11 +248,29 @@ bool BaseProxy::Started()
 
 bool BaseProxy::Running()
 {
-    if (!closed && (client_connection.Closed() || server_connection.Closed()))
+    if (closed)
     {
-        Close();
+        return false;
+    }
+    if (client_connection.Closed() || server_connection.Closed())
+    {
+        // Close on the strand, as the sockets are not thread safe. The posted
+        // handler keeps this proxy alive even if its owner drops it right away
+        asio::post(strand, std::bind(&BaseProxy::Close, shared_from_this()));
+        return false;
+    }
+    return true;
+}
+
+void BaseProxy::CloseIfIdle(const std::chrono::steady_clock::time_point now, const std::chrono::steady_clock::duration timeout)
+{
+    if (closed || !(client_connection.IsIdle(now, timeout) || server_connection.IsIdle(now, timeout)))
+    {
+        return;
     }
-    return !closed;
+
+    // Close on the strand, as the sockets are not thread safe
+    asio::post(strand, std::bind(&BaseProxy::Close, shared_from_this()));
 }
 
 asio::ip::tcp::socket& BaseProxy::ClientSocket()
@@ -121,138 +283,184 @@ size_t BaseProxy::ProcessData(const std::vector<unsigned char>::const_iterator&
     Connection& dst_connection = source == Endpoint::Server ? client_connection : server_connection;
 
     // Transfer the data to the other endpoint
-    dst_connection.WriteData(&(*data), length);
+    dst_connection.WriteData(ShareData(data, length, source));
     return length;
 }
 
-void BaseProxy::NotifyServerData(const size_t length)
+BufferSlice BaseProxy::ShareData(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source)
 {
+    const std::shared_ptr<std::vector<unsigned char>>& spilled_data = source == Endpoint::Server ? server_spilled_data : client_spilled_data;
+    const unsigned char* const first = &(*data);
+
+    // Data are either in the spilled data vector or still in the ring buffer
+    if (!spilled_data->empty() && first >= spilled_data->data() && first < spilled_data->data() + spilled_data->size())
     {
-        std::lock_guard<std::mutex> data_sources_lock(data_sources_mutex);
-        data_sources.push_back({ Endpoint::Server, length });
+        return BufferSlice(spilled_data, spilled_data->data() + (first - spilled_data->data()), length);
     }
-    data_source_cv.notify_one();
+
+    Connection& src_connection = source == Endpoint::Server ? server_connection : client_connection;
+    return src_connection.GetReceivedData().Share(first, length);
 }
 
-void BaseProxy::NotifyClientData(const size_t length)
+void BaseProxy::PauseLane(const Endpoint source, const std::chrono::steady_clock::duration duration)
 {
+    (source == Endpoint::Server ? server_lane_paused : client_lane_paused) = true;
+    asio::steady_timer& timer = source == Endpoint::Server ? server_lane_timer : client_lane_timer;
+    timer.expires_after(duration);
+    // Runs on the lane, and resumes the processing of what has been received in the meantime
+    timer.async_wait([this, self = shared_from_this(), source](const asio::error_code& ec) {
+        // Timer re-armed by another PauseLane call, the lane stays paused until the new wait completes
+        if (ec == asio::error::operation_aborted)
+        {
+            return;
+        }
+        (source == Endpoint::Server ? server_lane_paused : client_lane_paused) = false;
+        NotifyNewData(source);
+    });
+}
+
+bool BaseProxy::IsLanePaused(const Endpoint source) const
+{
+    return source == Endpoint::Server ? server_lane_paused : client_lane_paused;
+}
+
+void BaseProxy::NotifyNewData(const Endpoint source)
+{
+    std::atomic<bool>& processing_scheduled = source == Endpoint::Server ? server_processing_scheduled : client_processing_scheduled;
+    // Only post the processing if it's not already scheduled
+    if (!processing_scheduled.exchange(true))
     {
-        std::lock_guard<std::mutex> data_sources_lock(data_sources_mutex);
-        data_sources.push_back({ Endpoint::Client, length });
+        asio::post(source == Endpoint::Server ? server_lane : client_lane, std::bind(&BaseProxy::ReadIncomingData, shared_from_this(), source));
     }
-    data_source_cv.notify_one();
 }
 
-void BaseProxy::ReadIncomingData()
+void BaseProxy::ReadIncomingData(const Endpoint source)
 {
-    // Run indefinitely
-    while (!closed)
+    // Data received after this point will schedule a new processing
+    (source == Endpoint::Server ? server_processing_scheduled : client_processing_scheduled) = false;
+
+    if (closed)
     {
-        if (server_connection.Closed() && client_connection.Closed())
+        return;
+    }
+
+    // Sockets are closed on the strand, as they are not thread safe
+    if (server_connection.Closed() || client_connection.Closed())
+    {
+        asio::post(strand, std::bind(&BaseProxy::Close, shared_from_this()));
+        return;
+    }
+
+    try
+    {
+        bool data_consumed = true;
+        while (data_consumed && !closed)
         {
-            Close();
-            break;
+            data_consumed = ProcessReceivedData(source);
         }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Exception when reading the data: " << e.what() << std::endl;
+        asio::post(strand, std::bind(&BaseProxy::Close, shared_from_this()));
+    }
+}
+
+bool BaseProxy::ProcessReceivedData(const Endpoint source)
+{
+    Connection& src_connection = source == Endpoint::Server ? server_connection : client_connection;
+    ByteRingBuffer& received_data = src_connection.GetReceivedData();
+    std::shared_ptr<std::vector<unsigned char>>& spilled_data = source == Endpoint::Server ? server_spilled_data : client_spilled_data;
+    size_t& spilled_data_start = source == Endpoint::Server ? server_spilled_data_start : client_spilled_data_start;
+
+    // The other side can't keep up, stop consuming. When received_data is full the
+    // source socket stops being read, and we'll be notified when the writes are drained
+    Connection& dst_connection = source == Endpoint::Server ? client_connection : server_connection;
+    if (dst_connection.IsWriteQueueFull() || IsLanePaused(source))
+    {
+        return false;
+    }
 
-        // Wait for some data
+    // Some data were previously moved out of the ring buffer, continue with them
+    if (spilled_data_start < spilled_data->size())
+    {
+        size_t data_to_remove = ProcessData(spilled_data->cbegin() + spilled_data_start, spilled_data->size() - spilled_data_start, source);
+        if (data_to_remove == 0)
         {
-            std::unique_lock<std::mutex> data_source_lock(data_sources_mutex);
-            process_data_ready = true;
-            data_source_cv.wait(data_source_lock);
+            // Only a partial packet is left, drop what has already
+            // been processed and append everything new after it
+            CompactSpilledData(spilled_data, spilled_data_start);
+            if (received_data.MoveTo(*spilled_data) == 0)
+            {
+                return false;
+            }
+            src_connection.NotifyDataConsumed();
+            return true;
         }
 
-        if (closed)
+        if (data_to_remove > spilled_data->size() - spilled_data_start)
         {
-            break;
+            std::cerr << "Warning, asked to remove more data than possible" << std::endl;
+            data_to_remove = spilled_data->size() - spilled_data_start;
         }
 
-        try
+        spilled_data_start += data_to_remove;
+        // Everything has been processed, next packets can be read directly from the ring buffer
+        if (spilled_data_start == spilled_data->size())
         {
-            while (!data_sources.empty())
-            {
-                Endpoint data_source = Endpoint::Server;
-                // Retrieve the origin of the data, but don't remove it in case we need
-                // to wait for more data to get a full packet
-                {
-                    std::lock_guard<std::mutex> data_source_lock(data_sources_mutex);
-                    data_source = data_sources.front().first;
-                }
-
-                // Process the data coming from this endpoint
-                Connection& src_connection = data_source == Endpoint::Server ? server_connection : client_connection;
-                std::vector<unsigned char>& received_data = data_source == Endpoint::Server ? server_received_data : client_received_data;
-                // Read all new data from this connection
-                src_connection.RetreiveData(received_data);
-
-                // Do something with the data
-                size_t data_to_remove = ProcessData(received_data.cbegin(), received_data.size(), data_source);
-
-                if (data_to_remove == 0)
-                {
-                    continue;
-                }
-
-                if (data_to_remove > received_data.size())
-                {
-                    std::cerr << "Warning, asked to remove more data than possible" << std::endl;
-                    data_to_remove = received_data.size();
-                }
-
-                // Remove the data from the buffer
-                received_data.erase(received_data.begin(), received_data.begin() + data_to_remove);
-
-                // Remove all data_sources elements that refers to data we already removed
-                {
-                    std::lock_guard<std::mutex> data_source_lock(data_sources_mutex);
-                    std::list<std::pair<Endpoint, size_t>>::iterator it = data_sources.begin();
-                    size_t already_removed = 0;
-                    while (it != data_sources.end())
-                    {
-                        // If this is from the endpoint we processed
-                        if (it->first == data_source)
-                        {
-                            // If we cleared all the data from this update, remove this entry
-                            // as it's fully processed, and increment the iterator to next item
-                            if (already_removed + it->second <= data_to_remove)
-                            {
-                                already_removed += it->second;
-                                data_sources.erase(it++);
-                            }
-                            // We only used part of the data from this update, so set it's new size
-                            else
-                            {
-                                it->second = it->second - (data_to_remove - already_removed);
-                                already_removed = data_to_remove;
-                            }
-
-                            // If we removed the right amount of elements, we can stop iterating the list
-                            if (already_removed == data_to_remove)
-                            {
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            ++it;
-                        }
-                    }
-                }
-
-                if (server_connection.Closed())
-                {
-                    client_connection.Close();
-                }
-                if (client_connection.Closed())
-                {
-                    server_connection.Close();
-                }
-            }
+            CompactSpilledData(spilled_data, spilled_data_start);
         }
-        catch (const std::exception& e)
+        return true;
+    }
+
+    size_t contiguous_size = 0;
+    const std::vector<unsigned char>::const_iterator data = received_data.Front(contiguous_size);
+    if (contiguous_size == 0)
+    {
+        return false;
+    }
+
+    // Do something with the data
+    size_t data_to_remove = ProcessData(data, contiguous_size, source);
+
+    if (data_to_remove == 0)
+    {
+        // Not enough contiguous data for a full packet. If the data continue
+        // at the beginning of the ring buffer or if it's full, move everything
+        // to the spilled data vector to get a contiguous packet
+        if (contiguous_size < received_data.ReadableSize() || received_data.WritableSize() == 0)
         {
-            std::cerr << "Exception when reading the data: " << e.what() << std::endl;
-            client_connection.Close();
-            server_connection.Close();
+            CompactSpilledData(spilled_data, spilled_data_start);
+            received_data.MoveTo(*spilled_data);
+            src_connection.NotifyDataConsumed();
+            return true;
         }
+        return false;
+    }
+
+    if (data_to_remove > contiguous_size)
+    {
+        std::cerr << "Warning, asked to remove more data than possible" << std::endl;
+        data_to_remove = contiguous_size;
+    }
+
+    // Remove the data from the buffer
+    received_data.Consume(data_to_remove);
+    src_connection.NotifyDataConsumed();
+
+    return true;
+}
+
+void BaseProxy::CompactSpilledData(std::shared_ptr<std::vector<unsigned char>>& spilled_data, size_t& spilled_data_start)
+{
+    // Some slices still reference these bytes, they can't be moved
+    if (spilled_data.use_count() > 1)
+    {
+        spilled_data = std::make_shared<std::vector<unsigned char>>(spilled_data->cbegin() + spilled_data_start, spilled_data->cend());
+    }
+    else if (spilled_data_start > 0)
+    {
+        spilled_data->erase(spilled_data->begin(), spilled_data->begin() + spilled_data_start);
     }
+    spilled_data_start = 0;
 }
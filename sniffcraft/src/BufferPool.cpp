@@ -0,0 +1,257 @@
+#include "sniffcraft/BufferPool.hpp"
+
+#include <array>
+#include <mutex>
+#include <utility>
+
+namespace
+{
+    /// @brief Capacity of the smallest class is 2^min_class_log2 bytes, smaller buffers are not worth pooling
+    constexpr size_t min_class_log2 = 6;
+    /// @brief Capacity of the biggest class is 2^max_class_log2 bytes, bigger buffers are freed when released
+    constexpr size_t max_class_log2 = 24;
+    constexpr size_t num_classes = max_class_log2 - min_class_log2 + 1;
+    /// @brief Only the classes below 2^max_thread_class_log2 bytes are cached per thread
+    constexpr size_t max_thread_class_log2 = 16;
+    constexpr size_t num_thread_classes = max_thread_class_log2 - min_class_log2 + 1;
+    /// @brief Max number of buffers of each class cached by each thread
+    constexpr size_t max_thread_buffers = 8;
+    /// @brief Max number of bytes of each class kept in the shared lists
+    constexpr size_t max_shared_bytes = 32 * 1024 * 1024;
+
+    /// @brief Get the class of a released buffer, the biggest one it can fully serve
+    /// @return The class index, or num_classes if it can't be pooled
+    size_t ClassOfCapacity(const size_t capacity)
+    {
+        if (capacity < (size_t{ 1 } << min_class_log2))
+        {
+            return num_classes;
+        }
+        size_t log2 = min_class_log2;
+        while (log2 < max_class_log2 && (size_t{ 1 } << (log2 + 1)) <= capacity)
+        {
+            log2 += 1;
+        }
+        return (size_t{ 1 } << (log2 + 1)) <= capacity ? num_classes : log2 - min_class_log2;
+    }
+
+    /// @brief Get the class serving a requested capacity, the smallest one big enough
+    /// @return The class index, or num_classes if it's too big to be pooled
+    size_t ClassOfRequest(const size_t capacity)
+    {
+        size_t log2 = min_class_log2;
+        while (log2 <= max_class_log2 && (size_t{ 1 } << log2) < capacity)
+        {
+            log2 += 1;
+        }
+        return log2 - min_class_log2;
+    }
+
+    struct SharedLists
+    {
+        static SharedLists& GetInstance()
+        {
+            // Never destroyed, buffers can still be released during static destruction
+            static SharedLists* instance = new SharedLists();
+            return *instance;
+        }
+
+        std::array<std::mutex, num_classes> mutexes;
+        std::array<std::vector<std::vector<unsigned char>>, num_classes> buffers;
+    };
+
+    bool ReleaseShared(std::vector<unsigned char>&& buffer, const size_t class_index)
+    {
+        SharedLists& shared = SharedLists::GetInstance();
+        std::scoped_lock<std::mutex> lock(shared.mutexes[class_index]);
+        std::vector<std::vector<unsigned char>>& list = shared.buffers[class_index];
+        if ((list.size() + 1) << (class_index + min_class_log2) > max_shared_bytes)
+        {
+            return false;
+        }
+        list.push_back(std::move(buffer));
+        return true;
+    }
+
+    /// @brief Small buffers cached by a thread, acquired and released without any lock
+    struct ThreadCache
+    {
+        ~ThreadCache();
+
+        std::array<std::vector<std::vector<unsigned char>>, num_thread_classes> buffers;
+    };
+
+    thread_local ThreadCache thread_cache;
+    /// @brief Set when the thread cache is destroyed, buffers released after that go to the shared lists
+    thread_local bool thread_cache_destroyed = false;
+
+    ThreadCache::~ThreadCache()
+    {
+        thread_cache_destroyed = true;
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            for (std::vector<unsigned char>& buffer : buffers[i])
+            {
+                ReleaseShared(std::move(buffer), i);
+            }
+        }
+    }
+
+    void ReleaseBuffer(std::vector<unsigned char>&& buffer)
+    {
+        if (buffer.capacity() == 0)
+        {
+            return;
+        }
+
+        const size_t class_index = ClassOfCapacity(buffer.capacity());
+        if (class_index == num_classes)
+        {
+            BufferPoolCounters::dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.clear();
+        if (class_index < num_thread_classes && !thread_cache_destroyed)
+        {
+            std::vector<std::vector<unsigned char>>& list = thread_cache.buffers[class_index];
+            if (list.size() < max_thread_buffers)
+            {
+                list.push_back(std::move(buffer));
+                return;
+            }
+        }
+
+        if (!ReleaseShared(std::move(buffer), class_index))
+        {
+            BufferPoolCounters::dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+PooledBuffer::PooledBuffer()
+{
+
+}
+
+PooledBuffer::PooledBuffer(std::vector<unsigned char>&& bytes) : bytes(std::move(bytes))
+{
+
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept : bytes(std::move(other.bytes))
+{
+    // Make sure other doesn't keep any capacity it could give back to the pool
+    other.bytes = std::vector<unsigned char>();
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        ReleaseBuffer(std::move(bytes));
+        bytes = std::move(other.bytes);
+        other.bytes = std::vector<unsigned char>();
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer()
+{
+    ReleaseBuffer(std::move(bytes));
+}
+
+std::vector<unsigned char>& PooledBuffer::operator*()
+{
+    return bytes;
+}
+
+const std::vector<unsigned char>& PooledBuffer::operator*() const
+{
+    return bytes;
+}
+
+std::vector<unsigned char>* PooledBuffer::operator->()
+{
+    return &bytes;
+}
+
+const std::vector<unsigned char>* PooledBuffer::operator->() const
+{
+    return &bytes;
+}
+
+unsigned char* PooledBuffer::data()
+{
+    return bytes.data();
+}
+
+const unsigned char* PooledBuffer::data() const
+{
+    return bytes.data();
+}
+
+size_t PooledBuffer::size() const
+{
+    return bytes.size();
+}
+
+bool PooledBuffer::empty() const
+{
+    return bytes.empty();
+}
+
+std::vector<unsigned char>::const_iterator PooledBuffer::cbegin() const
+{
+    return bytes.cbegin();
+}
+
+std::vector<unsigned char>::const_iterator PooledBuffer::cend() const
+{
+    return bytes.cend();
+}
+
+PooledBuffer AcquireBuffer(const size_t capacity)
+{
+    const size_t class_index = ClassOfRequest(capacity);
+    if (class_index < num_classes)
+    {
+        if (class_index < num_thread_classes && !thread_cache_destroyed)
+        {
+            std::vector<std::vector<unsigned char>>& list = thread_cache.buffers[class_index];
+            if (!list.empty())
+            {
+                PooledBuffer buffer(std::move(list.back()));
+                list.pop_back();
+                BufferPoolCounters::reused_allocations.fetch_add(1, std::memory_order_relaxed);
+                return buffer;
+            }
+        }
+
+        SharedLists& shared = SharedLists::GetInstance();
+        std::scoped_lock<std::mutex> lock(shared.mutexes[class_index]);
+        std::vector<std::vector<unsigned char>>& list = shared.buffers[class_index];
+        if (!list.empty())
+        {
+            PooledBuffer buffer(std::move(list.back()));
+            list.pop_back();
+            BufferPoolCounters::reused_allocations.fetch_add(1, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+
+    BufferPoolCounters::heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    std::vector<unsigned char> bytes;
+    // Allocate the full class capacity so the buffer goes back to the same class
+    bytes.reserve(class_index < num_classes ? size_t{ 1 } << (class_index + min_class_log2) : capacity);
+    return PooledBuffer(std::move(bytes));
+}
+
+BufferPoolStats GetBufferPoolStats()
+{
+    BufferPoolStats stats;
+    stats.hits = BufferPoolCounters::reused_allocations.load(std::memory_order_relaxed);
+    stats.misses = BufferPoolCounters::heap_allocations.load(std::memory_order_relaxed);
+    stats.dropped = BufferPoolCounters::dropped.load(std::memory_order_relaxed);
+    return stats;
+}
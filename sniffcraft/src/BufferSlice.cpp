@@ -0,0 +1,45 @@
+#include "sniffcraft/BufferSlice.hpp"
+#include "sniffcraft/PoolAllocator.hpp"
+
+BufferSlice::BufferSlice() :
+    ptr(nullptr),
+    length(0)
+{
+
+}
+
+BufferSlice::BufferSlice(PooledBuffer&& bytes)
+{
+    std::shared_ptr<PooledBuffer> owned_bytes = std::allocate_shared<PooledBuffer>(PoolAllocator<PooledBuffer, BufferPoolCounters>(), std::move(bytes));
+    ptr = owned_bytes->data();
+    length = owned_bytes->size();
+    owner = std::move(owned_bytes);
+}
+
+BufferSlice::BufferSlice(const std::shared_ptr<const void>& owner, unsigned char* const data, const size_t length) :
+    owner(owner),
+    ptr(data),
+    length(length)
+{
+
+}
+
+const unsigned char* BufferSlice::data() const
+{
+    return ptr;
+}
+
+unsigned char* BufferSlice::mutable_data()
+{
+    return ptr;
+}
+
+size_t BufferSlice::size() const
+{
+    return length;
+}
+
+bool BufferSlice::empty() const
+{
+    return length == 0;
+}
@@ -0,0 +1,166 @@
+#include "sniffcraft/ByteRingBuffer.hpp"
+#include "sniffcraft/PoolAllocator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+ByteRingBuffer::ByteRingBuffer(const size_t capacity) :
+    data(capacity),
+    mask(capacity - 1)
+{
+    if (capacity == 0 || (capacity & mask) != 0)
+    {
+        throw std::runtime_error("ByteRingBuffer capacity must be a power of two");
+    }
+    write_position = 0;
+    read_position = 0;
+    release_position = 0;
+    first_retained_id = 0;
+}
+
+size_t ByteRingBuffer::WritableSize() const
+{
+    return data.size() - (write_position.load(std::memory_order_relaxed) - release_position.load(std::memory_order_acquire));
+}
+
+size_t ByteRingBuffer::Write(const unsigned char* const src, const size_t length)
+{
+    const size_t write_pos = write_position.load(std::memory_order_relaxed);
+    const size_t written = std::min(length, WritableSize());
+    if (written == 0)
+    {
+        return 0;
+    }
+
+    const size_t start = write_pos & mask;
+    const size_t first_part = std::min(written, data.size() - start);
+    std::memcpy(data.data() + start, src, first_part);
+    if (first_part < written)
+    {
+        std::memcpy(data.data(), src + first_part, written - first_part);
+    }
+
+    // Make the bytes visible to the consumer
+    write_position.store(write_pos + written, std::memory_order_release);
+    return written;
+}
+
+unsigned char* ByteRingBuffer::WriteRegion(size_t& contiguous_size)
+{
+    const size_t start = write_position.load(std::memory_order_relaxed) & mask;
+    contiguous_size = std::min(WritableSize(), data.size() - start);
+    return data.data() + start;
+}
+
+void ByteRingBuffer::Commit(const size_t length)
+{
+    write_position.store(write_position.load(std::memory_order_relaxed) + length, std::memory_order_release);
+}
+
+size_t ByteRingBuffer::ReadableSize() const
+{
+    return write_position.load(std::memory_order_acquire) - read_position.load(std::memory_order_relaxed);
+}
+
+std::vector<unsigned char>::const_iterator ByteRingBuffer::Front(size_t& contiguous_size) const
+{
+    const size_t start = read_position.load(std::memory_order_relaxed) & mask;
+    contiguous_size = std::min(ReadableSize(), data.size() - start);
+    return data.cbegin() + start;
+}
+
+void ByteRingBuffer::Consume(const size_t length)
+{
+    const size_t read_pos = read_position.load(std::memory_order_relaxed);
+    read_position.store(read_pos + std::min(length, ReadableSize()), std::memory_order_release);
+
+    // Give the space back to the producer, up to the first byte still shared
+    std::lock_guard<std::mutex> lock(retained_mutex);
+    UpdateReleasePosition();
+}
+
+size_t ByteRingBuffer::MoveTo(std::vector<unsigned char>& dst)
+{
+    const size_t readable = ReadableSize();
+    if (readable == 0)
+    {
+        return 0;
+    }
+
+    const size_t start = read_position.load(std::memory_order_relaxed) & mask;
+    const size_t first_part = std::min(readable, data.size() - start);
+    dst.insert(dst.end(), data.cbegin() + start, data.cbegin() + start + first_part);
+    if (first_part < readable)
+    {
+        dst.insert(dst.end(), data.cbegin(), data.cbegin() + (readable - first_part));
+    }
+
+    Consume(readable);
+    return readable;
+}
+
+BufferSlice ByteRingBuffer::Share(const unsigned char* const first, const size_t length)
+{
+    const size_t read_pos = read_position.load(std::memory_order_relaxed);
+    const size_t index = static_cast<size_t>(first - data.data());
+    const size_t offset = (index - read_pos) & mask;
+
+    size_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(retained_mutex);
+        id = first_retained_id + retained.size();
+        retained.push_back({ read_pos + offset, false });
+    }
+
+    // The deleter keeps the buffer alive, as the slice can outlive the connection.
+    // The control block is recycled as one is needed for every forwarded packet
+    std::shared_ptr<ByteRingBuffer> self = shared_from_this();
+    return BufferSlice(
+        std::shared_ptr<const void>(first, [self, id](const void*) { self->Release(id); }, PoolAllocator<void, BufferPoolCounters>()),
+        data.data() + index, length
+    );
+}
+
+void ByteRingBuffer::SetReleaseCallback(const std::function<void()>& callback)
+{
+    std::lock_guard<std::mutex> lock(retained_mutex);
+    release_callback = callback;
+}
+
+void ByteRingBuffer::Release(const size_t id)
+{
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> lock(retained_mutex);
+        retained[id - first_retained_id].second = true;
+        // Slices can be destroyed in any order, but space can only
+        // be given back once all the previous ones are released too
+        while (!retained.empty() && retained.front().second)
+        {
+            retained.pop_front();
+            first_retained_id += 1;
+        }
+        if (!UpdateReleasePosition())
+        {
+            return;
+        }
+        callback = release_callback;
+    }
+
+    if (callback)
+    {
+        callback();
+    }
+}
+
+bool ByteRingBuffer::UpdateReleasePosition()
+{
+    const size_t new_release_position = retained.empty() ? read_position.load(std::memory_order_relaxed) : retained.front().first;
+    if (new_release_position == release_position.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    release_position.store(new_release_position, std::memory_order_release);
+    return true;
+}
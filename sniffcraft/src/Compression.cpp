@@ -1,34 +1,22 @@
+#include "sniffcraft/BufferPool.hpp"
 #include "sniffcraft/Compression.hpp"
 
 #include <zlib.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 #include <string>
 #include <cstring>
 #include <stdexcept>
 #include <fstream>
 
-std::vector<unsigned char> Compress(const std::vector<unsigned char> &data)
-{
-    unsigned long compressed_size = compressBound(data.size());
-
-    std::vector<unsigned char> compressed_data(compressed_size);
-    int status = compress2(compressed_data.data(), &compressed_size, data.data(), data.size(), Z_DEFAULT_COMPRESSION);
-
-    if (status != Z_OK)
-    {
-        throw(std::runtime_error("Error compressing packet"));
-    }
-
-    // Shrink to keep only real data
-    compressed_data.resize(compressed_size);
-    return compressed_data;
-}
-
 std::vector<unsigned char> Decompress(const unsigned char* compressed, const size_t size)
 {
     std::vector<unsigned char> decompressed_data;
     decompressed_data.reserve(size);
 
-    std::vector<unsigned char> buffer(64 * 1024);
+    PooledBuffer buffer = AcquireBuffer(64 * 1024);
+    buffer->resize(64 * 1024);
 
     z_stream strm;
     memset(&strm, 0, sizeof(strm));
@@ -49,7 +37,7 @@ std::vector<unsigned char> Decompress(const unsigned char* compressed, const siz
         switch (res)
         {
         case Z_OK:
-            decompressed_data.insert(decompressed_data.end(), buffer.begin(), buffer.end() - strm.avail_out);
+            decompressed_data.insert(decompressed_data.end(), buffer.cbegin(), buffer.cend() - strm.avail_out);
             strm.next_out = buffer.data();
             strm.avail_out = buffer.size();
             if (strm.avail_in == 0)
@@ -59,7 +47,7 @@ std::vector<unsigned char> Decompress(const unsigned char* compressed, const siz
             }
             break;
         case Z_STREAM_END:
-            decompressed_data.insert(decompressed_data.end(), buffer.begin(), buffer.end() - strm.avail_out);
+            decompressed_data.insert(decompressed_data.end(), buffer.cbegin(), buffer.cend() - strm.avail_out);
             inflateEnd(&strm);
             return decompressed_data;
             break;
@@ -71,6 +59,202 @@ std::vector<unsigned char> Decompress(const unsigned char* compressed, const siz
     }
 }
 
+Decompressor::Decompressor() : stream(std::make_unique<z_stream>())
+{
+    memset(stream.get(), 0, sizeof(z_stream));
+    const int res = inflateInit(stream.get());
+    if (res != Z_OK)
+    {
+        throw(std::runtime_error("inflateInit failed: " + std::string(stream->msg != nullptr ? stream->msg : "")));
+    }
+#ifdef USE_LIBDEFLATE
+    decompressor = libdeflate_alloc_decompressor();
+    if (decompressor == nullptr)
+    {
+        inflateEnd(stream.get());
+        throw(std::runtime_error("libdeflate_alloc_decompressor failed"));
+    }
+#endif
+}
+
+Decompressor::~Decompressor()
+{
+    inflateEnd(stream.get());
+#ifdef USE_LIBDEFLATE
+    libdeflate_free_decompressor(decompressor);
+#endif
+}
+
+const std::vector<unsigned char>& Decompressor::Decompress(const unsigned char* compressed, const size_t size, const size_t decompressed_size)
+{
+    // Keep the capacity from the previous packets, no allocation once it's big enough
+    output.resize(decompressed_size);
+
+#ifdef USE_LIBDEFLATE
+    // Without actual_out_nbytes_ret, libdeflate fails if the output is not exactly decompressed_size
+    switch (libdeflate_zlib_decompress(decompressor, compressed, size, output.data(), output.size(), nullptr))
+    {
+    case LIBDEFLATE_SUCCESS:
+        return output;
+    case LIBDEFLATE_SHORT_OUTPUT:
+    case LIBDEFLATE_INSUFFICIENT_SPACE:
+        throw(std::runtime_error("Inflate decompression failed: decompressed size mismatch"));
+    default:
+        throw(std::runtime_error("Inflate decompression failed: invalid data"));
+    }
+#else
+    inflateReset(stream.get());
+    stream->next_in = const_cast<unsigned char*>(compressed);
+    stream->avail_in = static_cast<uInt>(size);
+    stream->next_out = output.data();
+    stream->avail_out = static_cast<uInt>(output.size());
+
+    // Output buffer has the exact decompressed size, everything can be inflated in one call
+    const int res = inflate(stream.get(), Z_FINISH);
+    if (res != Z_STREAM_END)
+    {
+        throw(std::runtime_error("Inflate decompression failed: " + std::string(stream->msg != nullptr ? stream->msg : "decompressed size mismatch")));
+    }
+    if (stream->avail_out != 0)
+    {
+        throw(std::runtime_error("Inflate decompression failed: decompressed size mismatch"));
+    }
+
+    return output;
+#endif
+}
+
+const std::vector<unsigned char>& Decompressor::DecompressHead(const unsigned char* compressed, const size_t size, const size_t max_size)
+{
+    output.resize(max_size);
+
+    inflateReset(stream.get());
+    stream->next_in = const_cast<unsigned char*>(compressed);
+    stream->avail_in = static_cast<uInt>(size);
+    stream->next_out = output.data();
+    stream->avail_out = static_cast<uInt>(output.size());
+
+    const int res = inflate(stream.get(), Z_SYNC_FLUSH);
+    // Z_BUF_ERROR is expected if the output buffer is full before the end of the stream
+    if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR)
+    {
+        throw(std::runtime_error("Inflate decompression failed: " + std::string(stream->msg != nullptr ? stream->msg : "")));
+    }
+
+    output.resize(output.size() - stream->avail_out);
+    return output;
+}
+
+#ifdef USE_LIBDEFLATE
+/// @brief Convert a zlib compression level to libdeflate one
+static int LibdeflateLevel(const int zlib_level)
+{
+    // libdeflate levels go up to 12 but 0-9 have the same meaning as zlib ones
+    return zlib_level == Z_DEFAULT_COMPRESSION ? 6 : zlib_level;
+}
+
+Compressor::Compressor(const int level) : level(level)
+{
+    compressor = libdeflate_alloc_compressor(LibdeflateLevel(level));
+    if (compressor == nullptr)
+    {
+        throw(std::runtime_error("libdeflate_alloc_compressor failed"));
+    }
+}
+
+Compressor::~Compressor()
+{
+    libdeflate_free_compressor(compressor);
+}
+
+void Compressor::SetLevel(const int level_)
+{
+    if (level_ == level)
+    {
+        return;
+    }
+
+    libdeflate_compressor* new_compressor = libdeflate_alloc_compressor(LibdeflateLevel(level_));
+    if (new_compressor == nullptr)
+    {
+        throw(std::runtime_error("libdeflate_alloc_compressor failed"));
+    }
+    libdeflate_free_compressor(compressor);
+    compressor = new_compressor;
+    level = level_;
+}
+
+const std::vector<unsigned char>& Compressor::Compress(const unsigned char* data, const size_t size)
+{
+    // Keep the capacity from the previous calls, no allocation once it's big enough
+    output.resize(libdeflate_zlib_compress_bound(compressor, size));
+
+    const size_t compressed_size = libdeflate_zlib_compress(compressor, data, size, output.data(), output.size());
+    if (compressed_size == 0)
+    {
+        throw(std::runtime_error("Error compressing data"));
+    }
+
+    output.resize(compressed_size);
+    return output;
+}
+#else
+Compressor::Compressor(const int level) : stream(std::make_unique<z_stream>()), level(level)
+{
+    memset(stream.get(), 0, sizeof(z_stream));
+    const int res = deflateInit(stream.get(), level);
+    if (res != Z_OK)
+    {
+        throw(std::runtime_error("deflateInit failed: " + std::string(stream->msg != nullptr ? stream->msg : "")));
+    }
+}
+
+Compressor::~Compressor()
+{
+    deflateEnd(stream.get());
+}
+
+void Compressor::SetLevel(const int level_)
+{
+    if (level_ == level)
+    {
+        return;
+    }
+
+    // Nothing is pending between two Compress calls, the stream can be recreated
+    deflateEnd(stream.get());
+    memset(stream.get(), 0, sizeof(z_stream));
+    const int res = deflateInit(stream.get(), level_);
+    if (res != Z_OK)
+    {
+        throw(std::runtime_error("deflateInit failed: " + std::string(stream->msg != nullptr ? stream->msg : "")));
+    }
+    level = level_;
+}
+
+const std::vector<unsigned char>& Compressor::Compress(const unsigned char* data, const size_t size)
+{
+    deflateReset(stream.get());
+    // Keep the capacity from the previous calls, no allocation once it's big enough
+    output.resize(deflateBound(stream.get(), static_cast<uLong>(size)));
+
+    stream->next_in = const_cast<unsigned char*>(data);
+    stream->avail_in = static_cast<uInt>(size);
+    stream->next_out = output.data();
+    stream->avail_out = static_cast<uInt>(output.size());
+
+    // Output buffer is big enough for everything, compress in one call
+    const int res = deflate(stream.get(), Z_FINISH);
+    if (res != Z_STREAM_END)
+    {
+        throw(std::runtime_error("Error compressing data: " + std::string(stream->msg != nullptr ? stream->msg : "")));
+    }
+
+    output.resize(output.size() - stream->avail_out);
+    return output;
+}
+#endif
+
 std::tuple<size_t, size_t, unsigned long> CompressRawDeflateFile(std::ifstream& src_file, std::ofstream& dst_file)
 {
     z_stream strm;
@@ -1,63 +1,130 @@
 #include "sniffcraft/Connection.hpp"
 #include "sniffcraft/DataProcessor.hpp"
 
-Connection::Connection(asio::io_context& io_context) :
-    socket(io_context),
-    timeout_timer(io_context)
+#include <algorithm>
+
+Connection::Connection(const asio::strand<asio::io_context::executor_type>& strand) :
+    socket(strand),
+    received_data(std::make_shared<ByteRingBuffer>(RECEIVED_DATA_BUFFER_SIZE))
 {
-    read_buffer = std::vector<unsigned char>(BUFFER_SIZE);
+    read_size = MIN_READ_BUFFER_SIZE;
+    max_read_buffer_size = DEFAULT_MAX_READ_BUFFER_SIZE;
+    small_reads_count = 0;
+    reading_paused = false;
+    write_in_progress = false;
+    data_being_written_bytes = 0;
+    pending_write_bytes = 0;
+    write_high_watermark = DEFAULT_WRITE_HIGH_WATERMARK;
+    write_low_watermark = DEFAULT_WRITE_LOW_WATERMARK;
+    write_queue_full = false;
+    last_activity = 0;
     closed = false;
 }
 
 Connection::~Connection()
 {
+    // Slices of received_data can still be alive in the other connection
+    received_data->SetReleaseCallback(nullptr);
     Close();
 }
 
-void Connection::SetCallback(const std::function<void(const size_t)>& callback)
+void Connection::SetOwner(const std::weak_ptr<void>& owner_)
+{
+    owner = owner_;
+    // Some space might be given back when a slice is released after it has been written.
+    // Slices can outlive this connection and the callback is called after the ring
+    // buffer lock is released, so only use this connection if its owner is still alive
+    received_data->SetReleaseCallback([this, owner = owner]() {
+        if (const std::shared_ptr<void> locked_owner = owner.lock())
+        {
+            NotifyDataConsumed();
+        }
+    });
+}
+
+void Connection::SetCallback(const std::function<void()>& callback)
 {
     data_callback = callback;
 }
 
 void Connection::SetDataProcessor(std::unique_ptr<DataProcessor>& processor)
 {
-    // Lock mutex to prevent any race condition issue in WriteData, WriteLoop and handle_read
+    // Lock mutex to prevent any race condition issue in WriteData, StartWriting and handle_read
     std::lock_guard<std::mutex> processor_lock(data_processor_mutex);
     data_processor = std::move(processor);
 }
 
-void Connection::RetreiveData(std::vector<unsigned char>& dst)
+void Connection::SetMaxReadBufferSize(const size_t size)
 {
-    std::lock_guard<std::mutex> received_lock(received_mutex);
-    dst.insert(dst.end(), ready_received_data.begin(), ready_received_data.end());
-    ready_received_data.clear();
+    max_read_buffer_size = std::max(size, MIN_READ_BUFFER_SIZE);
 }
 
-void Connection::StartListeningAndWriting()
+void Connection::SetWriteWatermarks(const size_t high, const size_t low)
 {
-    write_thread_started = false;
-    write_thread = std::thread(&Connection::WriteLoop, this);
-    while (!write_thread_started)
-    {
+    write_high_watermark = high;
+    write_low_watermark = std::min(low, high);
+}
+
+void Connection::SetWriteDrainedCallback(const std::function<void()>& callback)
+{
+    write_drained_callback = callback;
+}
 
+bool Connection::IsWriteQueueFull() const
+{
+    return write_queue_full;
+}
+
+size_t Connection::GetPendingWriteBytes() const
+{
+    return pending_write_bytes;
+}
+
+ByteRingBuffer& Connection::GetReceivedData()
+{
+    return *received_data;
+}
+
+void Connection::NotifyDataConsumed()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Resume reading in the asio thread as the consumer freed some space
+    if (reading_paused && reading_paused.exchange(false))
+    {
+        asio::post(socket.get_executor(), [this, keep_alive = owner.lock()]() { StartReading(); });
     }
-    timeout_timer.expires_after(std::chrono::seconds(15));
-    timeout_timer.async_wait(
-        std::bind(&Connection::handle_timeout, this, std::placeholders::_1)
-    );
-    socket.async_read_some(asio::buffer(read_buffer.data(), BUFFER_SIZE),
-        std::bind(&Connection::handle_read, this,
-            std::placeholders::_1, std::placeholders::_2));
+}
+
+void Connection::StartListeningAndWriting()
+{
+    StampActivity();
+    StartReading();
 }
 
 void Connection::WriteData(const unsigned char* const data, const size_t length)
 {
+    PooledBuffer bytes = AcquireBuffer(length);
+    bytes->insert(bytes->end(), data, data + length);
+    WriteData(BufferSlice(std::move(bytes)));
+}
+
+void Connection::WriteData(BufferSlice&& data)
+{
+    // Lock both mutexes without deadlock
+    std::scoped_lock<std::mutex, std::mutex> data_processor_lock(data_processor_mutex, write_mutex);
+    const bool process = data_processor != nullptr;
+    if (pending_write_bytes.fetch_add(data.size()) + data.size() > write_high_watermark)
     {
-        // Lock both mutexes without deadlock
-        std::scoped_lock<std::mutex, std::mutex> data_processor_lock(data_processor_mutex, write_mutex);
-        data_to_write.push_back({ std::vector<unsigned char>(data, data + length), data_processor != nullptr });
+        write_queue_full = true;
+    }
+    data_to_write.push_back({ std::move(data), process });
+
+    // If a write is already in progress, this data will be sent when it's done
+    if (!write_in_progress)
+    {
+        write_in_progress = true;
+        asio::post(socket.get_executor(), [this, keep_alive = owner.lock()]() { StartWriting(); });
     }
-    write_cv.notify_one();
 }
 
 asio::ip::tcp::socket& Connection::GetSocket()
@@ -72,11 +139,6 @@ void Connection::Close()
     {
         socket.close();
     }
-    write_cv.notify_one();
-    if (write_thread.joinable())
-    {
-        write_thread.join();
-    }
 }
 
 bool Connection::Closed() const
@@ -84,56 +146,127 @@ bool Connection::Closed() const
     return closed;
 }
 
-void Connection::WriteLoop()
+void Connection::StampActivity()
 {
-    write_thread_started = true;
-    // Run indefinitely
-    while (!closed)
+    last_activity.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void Connection::StopIdleCheck()
+{
+    last_activity.store(0, std::memory_order_relaxed);
+}
+
+bool Connection::IsIdle(const std::chrono::steady_clock::time_point now, const std::chrono::steady_clock::duration timeout) const
+{
+    const std::chrono::steady_clock::rep last = last_activity.load(std::memory_order_relaxed);
+    if (last == 0)
+    {
+        return false;
+    }
+    return now - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(last)) > timeout;
+}
+
+void Connection::StartWriting()
+{
+    if (closed)
     {
-        // Wait for some data
+        return;
+    }
+
+    std::vector<std::pair<BufferSlice, bool>> next_written;
+    {
+        std::lock_guard<std::mutex> write_lock(write_mutex);
+        if (data_to_write.empty())
         {
-            std::unique_lock<std::mutex> write_lock(write_mutex);
-            write_cv.wait(write_lock);
+            write_in_progress = false;
+            return;
         }
+        std::swap(next_written, data_to_write);
+    }
 
-        if (closed)
+    data_being_written.clear();
+    write_buffers.clear();
+    data_being_written.reserve(next_written.size());
+    write_buffers.reserve(next_written.size());
+    data_being_written_bytes = 0;
+    for (std::pair<BufferSlice, bool>& d : next_written)
+    {
+        data_being_written_bytes += d.first.size();
+        if (d.second)
         {
-            break;
+            // If d.second is true it means data_processor is != nullptr so
+            // we don't really need the lock as it's never changed after creation
+            // std::lock_guard<std::mutex> data_processor_lock(data_processor_mutex);
+            // The slice is only referenced here, it can be transformed in place
+            data_processor->ProcessOutgoingData(d.first.mutable_data(), d.first.size());
         }
+        data_being_written.push_back(std::move(d.first));
+        write_buffers.push_back(asio::buffer(data_being_written.back().data(), data_being_written.back().size()));
+    }
+
+    // Gather all the buffers in one write
+    asio::async_write(socket, write_buffers,
+        [this, keep_alive = owner.lock()](const asio::error_code& ec, const size_t) {
+            handle_write(ec);
+        });
+}
 
-        while (!data_to_write.empty())
+void Connection::handle_write(const asio::error_code& ec)
+{
+    // Written slices are not needed anymore, release them
+    // so their received data space can be reused
+    data_being_written.clear();
+    write_buffers.clear();
+
+    const size_t pending = pending_write_bytes.fetch_sub(data_being_written_bytes) - data_being_written_bytes;
+    data_being_written_bytes = 0;
+    if (write_queue_full && pending <= write_low_watermark)
+    {
+        write_queue_full = false;
+        // Tell the other side it can send us data again
+        if (!ec && write_drained_callback)
         {
-            std::pair<std::vector<unsigned char>, bool> next_written;
-            {
-                std::lock_guard<std::mutex> write_lock(write_mutex);
-                next_written = data_to_write.front();
-                data_to_write.pop_front();
-            }
-
-
-            const unsigned char* data_ptr = next_written.first.data();
-            size_t data_length = next_written.first.size();
-
-            std::vector<unsigned char> processed_data;
-            if (next_written.second)
-            {
-                // If next_written.second is true it means data_processor is != nullptr so
-                // we don't really need the lock as it's never changed after creation
-                // std::lock_guard<std::mutex> data_processor_lock(data_processor_mutex);
-                processed_data = data_processor->ProcessOutgoingData(next_written.first);
-                data_ptr = processed_data.data();
-                data_length = processed_data.size();
-            }
-
-            asio::error_code ec;
-            asio::write(socket, asio::buffer(data_ptr, data_length), ec);
-            if (ec)
-            {
-                closed = true;
-                return;
-            }
+            write_drained_callback();
         }
     }
+
+    if (ec)
+    {
+        closed = true;
+        return;
+    }
+
+    // Send everything that has been added while we were writing
+    StartWriting();
+}
+
+void Connection::StartReading()
+{
+    if (closed)
+    {
+        return;
+    }
+
+    size_t contiguous_size = 0;
+    unsigned char* region = received_data->WriteRegion(contiguous_size);
+    while (contiguous_size == 0)
+    {
+        reading_paused = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // The consumer might have freed some space before reading_paused was set,
+        // in this case it won't resume reading so we have to retry now
+        if (received_data->WritableSize() == 0 || !reading_paused.exchange(false))
+        {
+            return;
+        }
+        region = received_data->WriteRegion(contiguous_size);
+    }
+
+    // Read straight into the ring free space, bytes are only visible to the consumer once committed
+    socket.async_read_some(asio::buffer(region, std::min(contiguous_size, read_size)),
+        [this, keep_alive = owner.lock()](const asio::error_code& ec, const size_t bytes_transferred) {
+            handle_read(ec, bytes_transferred);
+        });
 }
 
 void Connection::handle_read(const asio::error_code& ec, const size_t bytes_transferred)
@@ -149,50 +282,50 @@ void Connection::handle_read(const asio::error_code& ec, const size_t bytes_tran
         return;
     }
 
-    const std::vector<unsigned char>* data = &read_buffer;
-    size_t length = bytes_transferred;
-
-    std::vector<unsigned char> processed_data;
+    size_t contiguous_size = 0;
+    unsigned char* region = received_data->WriteRegion(contiguous_size);
     {
         std::lock_guard<std::mutex> data_processor_lock(data_processor_mutex);
         if (data_processor != nullptr)
         {
-            processed_data = data_processor->ProcessIncomingData({ data->begin(), data->begin() + length });
-            data = &processed_data;
-            length = processed_data.size();
+            data_processor->ProcessIncomingData(region, bytes_transferred);
         }
     }
 
-    {
-        std::lock_guard<std::mutex> received_lock(received_mutex);
-        ready_received_data.insert(ready_received_data.end(), data->begin(), data->begin() + length);
+    received_data->Commit(bytes_transferred);
 
-        // We need to protect the callback call in the mutex scope
-        // otherwise we could have data in the buffer without the
-        // data length being transmitted correctly
-        if (data_callback)
-        {
-            data_callback(length);
-        }
+    if (data_callback)
+    {
+        data_callback();
     }
 
-    timeout_timer.cancel();
-    timeout_timer.expires_after(std::chrono::seconds(15));
-    timeout_timer.async_wait(
-        std::bind(&Connection::handle_timeout, this, std::placeholders::_1)
-    );
+    StampActivity();
+
+    AdaptReadBufferSize(bytes_transferred);
 
-    socket.async_read_some(asio::buffer(read_buffer.data(), BUFFER_SIZE),
-        std::bind(&Connection::handle_read, this,
-            std::placeholders::_1, std::placeholders::_2));
+    StartReading();
 }
 
-void Connection::handle_timeout(const asio::error_code& ec)
+void Connection::AdaptReadBufferSize(const size_t bytes_transferred)
 {
-    if (ec == asio::error::operation_aborted)
+    // Read was full, there are probably more bytes waiting, ask for more next time
+    if (bytes_transferred == read_size)
     {
-        return;
+        small_reads_count = 0;
+        read_size = std::min(2 * read_size, static_cast<size_t>(max_read_buffer_size));
+    }
+    // Traffic slowed down, shrink the reads after a few small ones
+    else if (bytes_transferred < read_size / 4)
+    {
+        small_reads_count += 1;
+        if (small_reads_count > 16 && read_size > MIN_READ_BUFFER_SIZE)
+        {
+            small_reads_count = 0;
+            read_size = std::max(read_size / 2, MIN_READ_BUFFER_SIZE);
+        }
+    }
+    else
+    {
+        small_reads_count = 0;
     }
-
-    Close();
 }
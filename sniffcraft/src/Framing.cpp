@@ -0,0 +1,65 @@
+#include "sniffcraft/Framing.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+size_t ReadVarIntNoThrow(const unsigned char* const data, const size_t length, int& value)
+{
+    // Most packet lengths and ids are one byte long
+    if (length > 0 && data[0] < 0x80)
+    {
+        value = data[0];
+        return 1;
+    }
+
+    std::uint32_t result = 0;
+    const size_t max_size = std::min(length, static_cast<size_t>(5));
+    for (size_t i = 0; i < max_size; ++i)
+    {
+        result |= static_cast<std::uint32_t>(data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0)
+        {
+            value = static_cast<int>(result);
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t VarIntSize(const int value)
+{
+    std::uint32_t remaining = static_cast<std::uint32_t>(value) >> 7;
+    size_t size = 1;
+    while (remaining != 0)
+    {
+        remaining >>= 7;
+        size += 1;
+    }
+    return size;
+}
+
+size_t FindCompleteFrames(const unsigned char* const data, const size_t length, std::vector<Frame>& frames)
+{
+    frames.clear();
+
+    size_t offset = 0;
+    while (offset < length)
+    {
+        int packet_size = 0;
+        const size_t length_size = ReadVarIntNoThrow(data + offset, length - offset, packet_size);
+        // Incomplete length, or invalid (and the next packet will never be complete)
+        if (length_size == 0 || packet_size <= 0)
+        {
+            break;
+        }
+        if (static_cast<size_t>(packet_size) > length - offset - length_size)
+        {
+            break;
+        }
+        frames.push_back({ length_size, static_cast<size_t>(packet_size) });
+        offset += length_size + packet_size;
+    }
+
+    return offset;
+}
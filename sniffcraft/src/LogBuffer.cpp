@@ -0,0 +1,98 @@
+#include "sniffcraft/LogBuffer.hpp"
+
+LogBuffer::LogBuffer()
+{
+
+}
+
+void LogBuffer::Append(const std::string_view s)
+{
+    buffer.append(s.data(), s.size());
+}
+
+void LogBuffer::Append(const char c)
+{
+    buffer.push_back(c);
+}
+
+void LogBuffer::AppendNumber(unsigned long long value, const int min_digits)
+{
+    // Enough for the 20 digits of the max unsigned long long
+    char digits[20];
+    int num_digits = 0;
+    do
+    {
+        digits[num_digits] = static_cast<char>('0' + value % 10);
+        value /= 10;
+        num_digits += 1;
+    } while (value != 0 && num_digits < 20);
+
+    for (int i = num_digits; i < min_digits; ++i)
+    {
+        buffer.push_back('0');
+    }
+    for (int i = num_digits - 1; i >= 0; --i)
+    {
+        buffer.push_back(digits[i]);
+    }
+}
+
+void LogBuffer::AppendTimestamp(const long long int elapsed_ms)
+{
+    const unsigned long long ms = elapsed_ms < 0 ? 0 : static_cast<unsigned long long>(elapsed_ms);
+    buffer.push_back('[');
+    AppendNumber(ms / 3600000);
+    buffer.push_back(':');
+    AppendNumber((ms / 60000) % 60, 2);
+    buffer.push_back(':');
+    AppendNumber((ms / 1000) % 60, 2);
+    buffer.push_back(':');
+    AppendNumber(ms % 1000, 3);
+    buffer.push_back(']');
+}
+
+void LogBuffer::AppendHex(const unsigned char* data, const size_t size)
+{
+    static constexpr char hex_digits[] = "0123456789ABCDEF";
+    if (size == 0)
+    {
+        return;
+    }
+
+    // "0xXX " for each byte, without the last space
+    const size_t start = buffer.size();
+    buffer.resize(start + 5 * size - 1);
+    char* out = buffer.data() + start;
+    for (size_t i = 0; i < size; ++i)
+    {
+        out[0] = '0';
+        out[1] = 'x';
+        out[2] = hex_digits[data[i] >> 4];
+        out[3] = hex_digits[data[i] & 0x0F];
+        if (i != size - 1)
+        {
+            out[4] = ' ';
+        }
+        out += 5;
+    }
+}
+
+void LogBuffer::WriteTo(std::ostream& stream) const
+{
+    stream.write(buffer.data(), buffer.size());
+}
+
+void LogBuffer::Clear()
+{
+    buffer.clear();
+}
+
+size_t LogBuffer::Size() const
+{
+    return buffer.size();
+}
+
+bool LogBuffer::Empty() const
+{
+    return buffer.empty();
+}
@@ -1,6 +1,8 @@
+#include "sniffcraft/BufferPool.hpp"
 #include "sniffcraft/conf.hpp"
 #include "sniffcraft/Compression.hpp"
 #include "sniffcraft/Logger.hpp"
+#include "sniffcraft/PacketPool.hpp"
 #include "sniffcraft/PacketUtilities.hpp"
 
 #include <cmath>
@@ -20,6 +22,9 @@
 
 using namespace ProtocolCraft;
 
+std::string_view GetNameFromId(const int id, const ConnectionState connection_state, const bool clientbound);
+std::vector<int> GetCustomPayloadIds(const ConnectionState connection_state, const bool clientbound);
+
 Logger::Logger()
 {
     start_time = std::chrono::system_clock::now();
@@ -29,24 +34,38 @@ Logger::Logger()
     ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d-%H-%M-%S");
     base_filename = ss.str();
 
-    last_time_checked_conf_file = 0;
     last_time_conf_file_loaded = 0;
     last_time_network_recap_printed = 0;
-
+    conf_version = 0;
+    clientbound_write_queue_bytes = 0;
+    clientbound_max_write_queue_bytes = 0;
+    serverbound_write_queue_bytes = 0;
+    serverbound_max_write_queue_bytes = 0;
+    capture_compression_level = -1;
+
+    // Get the generation first, a change during LoadConfig will be seen later
+    applied_conf_generation = LoggingEngine::GetInstance().GetConfGeneration();
     LoadConfig();
 
     is_running = true;
-    log_thread = std::thread(&Logger::LogConsume, this);
+    OpenSession();
 }
 
 #ifdef WITH_GUI
+// Nothing is logged in a loaded file, the session is never opened
 Logger::Logger(const std::filesystem::path& path)
 {
     base_filename = path.stem().string();
     is_running = false;
-    last_time_checked_conf_file = 0;
+    applied_conf_generation = 0;
     last_time_conf_file_loaded = 0;
     last_time_network_recap_printed = 0;
+    conf_version = 0;
+    clientbound_write_queue_bytes = 0;
+    clientbound_max_write_queue_bytes = 0;
+    serverbound_write_queue_bytes = 0;
+    serverbound_max_write_queue_bytes = 0;
+    capture_compression_level = -1;
 
     std::ifstream file(path, std::ios::in | std::ios::binary);
     file.unsetf(std::ios::skipws);
@@ -119,37 +138,22 @@ Logger::Logger(const std::filesystem::path& path)
 
 Logger::~Logger()
 {
-    is_running = false;
-    log_condition.notify_all();
-
-    while (!logging_queue.empty())
-    {
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    }
-
-    if (log_to_file)
-    {
-        log_file << GenerateNetworkRecap() << std::endl;
-    }
-    if (log_file.is_open())
-    {
-        log_file.close();
-    }
+    // Log worker logs everything already sent and closes the files before releasing the session
+    ReleaseSession();
+}
 
-    if (binary_file.is_open())
-    {
-        binary_file.close();
-    }
+void Logger::Log(const std::shared_ptr<Packet>& packet, const ConnectionState connection_state, const Endpoint origin, const size_t bandwidth_bytes)
+{
+    PushRecord({ packet, std::chrono::system_clock::now(), connection_state, origin, bandwidth_bytes });
+}
 
-    if (log_thread.joinable())
-    {
-        log_thread.join();
-    }
+void Logger::Log(std::vector<LogItem>&& items)
+{
+    PushRecords(std::move(items));
 }
 
-void Logger::Log(const std::shared_ptr<Packet>& packet, const ConnectionState connection_state, const Endpoint origin, const size_t bandwidth_bytes)
+void Logger::CreateLogFiles()
 {
-    std::lock_guard<std::mutex> log_guard(log_mutex);
     bool need_to_create_txt_file = log_to_file && !log_file.is_open();
     bool need_to_create_binary_file = log_to_binary_file && !binary_file.is_open();
     if (need_to_create_txt_file || need_to_create_binary_file)
@@ -168,9 +172,54 @@ void Logger::Log(const std::shared_ptr<Packet>& packet, const ConnectionState co
             binary_file.write(reinterpret_cast<const char*>(header.data()), header.size());
         }
     }
+}
 
-    logging_queue.push({ packet, std::chrono::system_clock::now(), connection_state, origin, bandwidth_bytes });
-    log_condition.notify_all();
+void Logger::LogSkipped(const ConnectionState connection_state, const Endpoint origin, const int packet_id, const size_t bandwidth_bytes)
+{
+    if (bandwidth_bytes == 0)
+    {
+        return;
+    }
+
+    const Endpoint simple_origin = SimpleOrigin(origin);
+    UpdateNetworkRecap(std::string(GetNameFromId(packet_id, connection_state, simple_origin == Endpoint::Server)), simple_origin, bandwidth_bytes);
+}
+
+void Logger::UpdateWriteQueueDepth(const Endpoint origin, const size_t pending_bytes)
+{
+    const bool clientbound = SimpleOrigin(origin) == Endpoint::Server;
+    (clientbound ? clientbound_write_queue_bytes : serverbound_write_queue_bytes) = pending_bytes;
+
+    std::atomic<size_t>& max_bytes = clientbound ? clientbound_max_write_queue_bytes : serverbound_max_write_queue_bytes;
+    size_t current_max = max_bytes;
+    while (pending_bytes > current_max && !max_bytes.compare_exchange_weak(current_max, pending_bytes))
+    {
+
+    }
+}
+
+std::set<int> Logger::GetSkippablePackets(const ConnectionState connection_state, const Endpoint origin)
+{
+    // Called from the network threads, read the last published snapshot
+    // instead of the conf values the log worker can be reloading
+    const std::shared_ptr<const SkippablePacketsMap> snapshot = std::atomic_load(&skippable_packets);
+    if (snapshot == nullptr)
+    {
+        return {};
+    }
+
+    const auto it = snapshot->find({ connection_state, origin });
+    if (it == snapshot->end())
+    {
+        return {};
+    }
+
+    return it->second;
+}
+
+unsigned int Logger::GetConfVersion() const
+{
+    return conf_version;
 }
 
 const std::string& Logger::GetBaseFilename() const
@@ -181,7 +230,7 @@ const std::string& Logger::GetBaseFilename() const
 void Logger::Stop()
 {
     is_running = false;
-    log_condition.notify_all();
+    CloseSession();
 }
 
 #ifdef WITH_GUI
@@ -510,6 +559,14 @@ std::tuple<std::shared_ptr<Packet>, ConnectionState, Endpoint> Logger::Render()
         ImGui::SameLine();
         RenderNetworkData(serverbound_network_recap_data, serverbound_total_network_recap, 0.5f * (available_space.x - ImGui::GetStyle().ItemSpacing.x), "Client --> Server", running_s, bandwidth_per_s_serverbound, count_per_s_serverbound);
     }
+    if (is_running)
+    {
+        ImGui::Text("Write queue (current/max bytes): Server --> Client %zu/%zu | Client --> Server %zu/%zu",
+            clientbound_write_queue_bytes.load(), clientbound_max_write_queue_bytes.load(),
+            serverbound_write_queue_bytes.load(), serverbound_max_write_queue_bytes.load());
+        const PacketPoolStats packet_pool_stats = GetPacketPoolStats();
+        ImGui::Text("Packet pool (heap allocations/reused): %zu/%zu", packet_pool_stats.heap_allocations, packet_pool_stats.reused_allocations);
+    }
 
     ImGui::PopID();
     return return_value;
@@ -554,208 +611,182 @@ void Logger::UpdateFilteredPackets()
 }
 #endif
 
-void Logger::LogConsume()
+void Logger::Consume(LogItem& item)
 {
-    while (is_running)
+    CreateLogFiles();
+
+    const bool log_text = log_to_file || log_to_console;
+    if (item.packet == nullptr)
     {
+        if (log_text)
         {
-            std::unique_lock<std::mutex> lock(log_mutex);
-            log_condition.wait(lock);
+            AppendLineHeader(item);
+            log_buffer.Append("UNKNOWN OR WRONGLY PARSED MESSAGE\n");
         }
-        while (!logging_queue.empty())
-        {
-            LogItem item;
-            {
-                std::lock_guard<std::mutex> log_guard(log_mutex);
-                item = logging_queue.front();
-                logging_queue.pop();
-            }
-
-            auto hours = std::chrono::duration_cast<std::chrono::hours>(item.date - start_time).count();
-            auto min = std::chrono::duration_cast<std::chrono::minutes>(item.date - start_time).count();
-            auto sec = std::chrono::duration_cast<std::chrono::seconds>(item.date - start_time).count();
-            auto millisec = std::chrono::duration_cast<std::chrono::milliseconds>(item.date - start_time).count();
-
-            millisec -= sec * 1000;
-            sec -= min * 60;
-            min -= hours * 60;
+        return;
+    }
 
-            std::stringstream output;
+    GetPacketName(item, consumed_packet_name);
 
-            if (item.packet == nullptr)
-            {
-                output
-                    << '['
-                    << hours
-                    << ':'
-                    << std::setw(2) << std::setfill('0') << min
-                    << ':'
-                    << std::setw(2) << std::setfill('0') << sec
-                    << ':'
-                    << std::setw(3) << std::setfill('0') << millisec
-                    << "] "
-                    << ConnectionStateToString(item.connection_state) << ' '
-                    << OriginToString(item.origin) << ' ';
-                output << "UNKNOWN OR WRONGLY PARSED MESSAGE";
-                const std::string output_str = output.str();
-                if (log_to_file)
-                {
-                    log_file << output_str << std::endl;
-                }
-                if (log_to_console)
-                {
-                    std::cout << output_str << std::endl;
-                }
-                continue;
-            }
-
-            const std::string packet_name = GetPacketName(item);
+    // Update network recap data
+    if (item.bandwidth_bytes > 0)
+    {
+        UpdateNetworkRecap(consumed_packet_name, SimpleOrigin(item.origin), item.bandwidth_bytes);
+    }
 
-            // Update network recap data
-            if (item.bandwidth_bytes > 0)
+    if (log_to_binary_file)
+    {
+        // Network size is usually compressed, reserve more to avoid growing the buffer
+        PooledBuffer serialized = AcquireBuffer(4 * item.bandwidth_bytes + 32);
+        WriteData<VarInt>(static_cast<int>(item.connection_state), *serialized);
+        WriteData<VarInt>(static_cast<int>(item.origin), *serialized);
+        const long long int time_since_epoch = std::chrono::system_clock::to_time_t(item.date);
+        WriteData<VarLong>(static_cast<long long int>(std::chrono::duration_cast<std::chrono::milliseconds>(item.date - start_time).count()), *serialized);
+        WriteData<VarLong>(static_cast<long long int>(item.bandwidth_bytes), *serialized);
+        item.packet->Write(*serialized);
+        PooledBuffer serialized_header = AcquireBuffer(8);
+        WriteData<bool>(serialized.size() > 256, *serialized_header);
+        const std::vector<unsigned char>* record = &(*serialized);
+        if (serialized.size() > 256)
+        {
+            if (capture_compressor == nullptr)
             {
-                std::scoped_lock lock(network_recap_mutex);
-                const Endpoint simple_origin = SimpleOrigin(item.origin);
-                std::map<std::string, NetworkRecapItem>& recap_data_map = simple_origin == Endpoint::Server ? clientbound_network_recap_data : serverbound_network_recap_data;
-
-                NetworkRecapItem& recap = recap_data_map[packet_name];
-                recap.count += 1;
-                recap.bandwidth_bytes += item.bandwidth_bytes;
-
-                NetworkRecapItem& total_recap_item = simple_origin == Endpoint::Server ? clientbound_total_network_recap : serverbound_total_network_recap;
-                total_recap_item.count += 1;
-                total_recap_item.bandwidth_bytes += item.bandwidth_bytes;
+                capture_compressor = std::make_unique<Compressor>(capture_compression_level);
             }
+            capture_compressor->SetLevel(capture_compression_level);
+            record = &capture_compressor->Compress(serialized.data(), serialized.size());
+        }
+        WriteData<VarInt>(static_cast<int>(record->size()), *serialized_header);
+        binary_file.write(reinterpret_cast<const char*>(serialized_header.data()), serialized_header.size());
+        binary_file.write(reinterpret_cast<const char*>(record->data()), record->size());
+    }
 
-            if (log_to_binary_file)
-            {
-                std::vector<unsigned char> serialized;
-                WriteData<VarInt>(static_cast<int>(item.connection_state), serialized);
-                WriteData<VarInt>(static_cast<int>(item.origin), serialized);
-                const long long int time_since_epoch = std::chrono::system_clock::to_time_t(item.date);
-                WriteData<VarLong>(static_cast<long long int>(std::chrono::duration_cast<std::chrono::milliseconds>(item.date - start_time).count()), serialized);
-                WriteData<VarLong>(static_cast<long long int>(item.bandwidth_bytes), serialized);
-                item.packet->Write(serialized);
-                std::vector<unsigned char> serialized_header;
-                WriteData<bool>(serialized.size() > 256, serialized_header);
-                if (serialized.size() > 256)
-                {
-                    serialized = Compress(serialized);
-                }
-                WriteData<VarInt>(static_cast<int>(serialized.size()), serialized_header);
-                binary_file.write(reinterpret_cast<const char*>(serialized_header.data()), serialized_header.size());
-                binary_file.write(reinterpret_cast<const char*>(serialized.data()), serialized.size());
-            }
+#ifdef WITH_GUI
+    if (in_gui)
+    {
+        std::scoped_lock<std::mutex> archive_lock(packets_history_mutex);
+        packets_history.push_back(item);
+    }
+#endif
 
+    {
+        std::scoped_lock lock(ignored_packets_mutex);
+        const std::set<int>& ignored_set = ignored_packets[{item.connection_state, SimpleOrigin(item.origin)}];
+        const bool is_ignored = ignored_set.find(item.packet->GetId()) != ignored_set.end();
 #ifdef WITH_GUI
-            if (in_gui)
+        // If this packet is ignored but we have an active filter on ignored packet, add it to display
+        if (in_gui)
+        {
+            std::scoped_lock<std::mutex> search_lock(search_mutex);
+            if (is_ignored &&
+                search_ignored_packets &&
+                !search_str.empty() &&
+                PacketNameMatch(item.packet->GetName(), ToLowerCase(search_str))
+            )
             {
-                std::scoped_lock<std::mutex> archive_lock(packets_history_mutex);
-                packets_history.push_back(item);
+                std::scoped_lock<std::mutex> history_lock(packets_history_mutex);
+                packets_history_filtered_indices.push_back(packets_history.size() - 1);
             }
+        }
 #endif
+        if (is_ignored)
+        {
+            return;
+        }
+    }
 
-            {
-                std::scoped_lock lock(ignored_packets_mutex);
-                const std::set<int>& ignored_set = ignored_packets[{item.connection_state, SimpleOrigin(item.origin)}];
-                const bool is_ignored = ignored_set.find(item.packet->GetId()) != ignored_set.end();
 #ifdef WITH_GUI
-                // If this packet is ignored but we have an active filter on ignored packet, add it to display
-                if (in_gui)
-                {
-                    std::scoped_lock<std::mutex> search_lock(search_mutex);
-                    if (is_ignored &&
-                        search_ignored_packets &&
-                        !search_str.empty() &&
-                        PacketNameMatch(item.packet->GetName(), ToLowerCase(search_str))
-                    )
-                    {
-                        std::scoped_lock<std::mutex> history_lock(packets_history_mutex);
-                        packets_history_filtered_indices.push_back(packets_history.size() - 1);
-                    }
-                }
+    if (in_gui)
+    {
+        std::scoped_lock<std::mutex, std::mutex> history_lock(packets_history_mutex, search_mutex);
+        if (search_str.empty() || PacketNameMatch(item.packet->GetName(), ToLowerCase(search_str)))
+        {
+            packets_history_filtered_indices.push_back(packets_history.size() - 1);
+        }
+    }
 #endif
-                if (is_ignored)
-                {
-                    continue;
-                }
-            }
 
-#ifdef WITH_GUI
-            if (in_gui)
-            {
-                std::scoped_lock<std::mutex, std::mutex> history_lock(packets_history_mutex, search_mutex);
-                if (search_str.empty() || PacketNameMatch(item.packet->GetName(), ToLowerCase(search_str)))
-                {
-                    packets_history_filtered_indices.push_back(packets_history.size() - 1);
-                }
-            }
-#endif
+    if (!log_text)
+    {
+        return;
+    }
 
-            const std::set<int>& detailed_set = detailed_packets[{item.connection_state, SimpleOrigin(item.origin)}];
-            const bool is_detailed = detailed_set.find(item.packet->GetId()) != detailed_set.end();
-
-            output
-                << '['
-                << hours
-                << ':'
-                << std::setw(2) << std::setfill('0') << min
-                << ':'
-                << std::setw(2) << std::setfill('0') << sec
-                << ':'
-                << std::setw(3) << std::setfill('0') << millisec
-                << "] "
-                << ConnectionStateToString(item.connection_state) << ' '
-                << OriginToString(item.origin) << ' ';
-            output << packet_name;
-            if (log_raw_bytes)
-            {
-                output << '\n';
-                std::vector<unsigned char> bytes;
-                item.packet->Write(bytes);
-                for (size_t i = 0; i < bytes.size(); ++i)
-                {
-                    output << "0x" << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << static_cast<int>(bytes[i]) << (i == bytes.size() - 1 ? "" : " ");
-                }
-            }
-            if (is_detailed)
-            {
+    const std::set<int>& detailed_set = detailed_packets[{item.connection_state, SimpleOrigin(item.origin)}];
+    const bool is_detailed = detailed_set.find(item.packet->GetId()) != detailed_set.end();
+
+    AppendLineHeader(item);
+    log_buffer.Append(consumed_packet_name);
+    if (log_raw_bytes)
+    {
+        log_buffer.Append('\n');
+        PooledBuffer bytes = AcquireBuffer(item.bandwidth_bytes + 32);
+        item.packet->Write(*bytes);
+        log_buffer.AppendHex(bytes.data(), bytes.size());
+    }
+    if (is_detailed)
+    {
+        log_buffer.Append('\n');
 #ifdef WITH_GUI
-                output << "\n" << RemoveParsingDetails(item.packet->Serialize()).Dump(4);
+        log_buffer.Append(RemoveParsingDetails(item.packet->Serialize()).Dump(4));
 #else
-                output << "\n" << item.packet->Serialize().Dump(4);
+        log_buffer.Append(item.packet->Serialize().Dump(4));
 #endif
-            }
+    }
+    log_buffer.Append('\n');
 
-            const std::string output_str = output.str();
-            if (log_to_file)
-            {
-                log_file << output_str << std::endl;
-            }
-            if (log_to_console)
-            {
-                std::cout << output_str << std::endl;
-            }
+    if (log_buffer.Size() >= LOG_FLUSH_SIZE)
+    {
+        Flush();
+    }
+}
 
-            // Every 5 seconds, check if the conf file has changed and reload it if needed
-            std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-            if (now - last_time_checked_conf_file > 5)
-            {
-                last_time_checked_conf_file = now;
-                LoadConfig();
-            }
+void Logger::OnBatchEnd()
+{
+    // The engine checks the conf file for all the sessions
+    const unsigned int conf_generation = LoggingEngine::GetInstance().GetConfGeneration();
+    if (conf_generation != applied_conf_generation)
+    {
+        applied_conf_generation = conf_generation;
+        // Lines already formatted go where they were supposed to
+        Flush();
+        LoadConfig();
+    }
 
-            // Every 10 seconds, print network recap if option is true
-            if (log_network_recap_console && now - last_time_network_recap_printed > 10)
-            {
-                last_time_network_recap_printed = now;
-                std::cout << GenerateNetworkRecap(10, 18) << std::endl;
-            }
-        }
+    // Every 10 seconds, print network recap if option is true
+    const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if (log_network_recap_console && now - last_time_network_recap_printed > 10)
+    {
+        last_time_network_recap_printed = now;
+        Flush();
+        std::cout << GenerateNetworkRecap(10, 18) << std::endl;
     }
+}
 
+void Logger::Flush()
+{
+    if (log_buffer.Empty())
+    {
+        return;
+    }
+    if (log_to_file && log_file.is_open())
+    {
+        log_buffer.WriteTo(log_file);
+        log_file.flush();
+    }
+    if (log_to_console)
+    {
+        log_buffer.WriteTo(std::cout);
+        std::cout.flush();
+    }
+    log_buffer.Clear();
+}
+
+void Logger::OnClose()
+{
+    Flush();
     if (log_file.is_open())
     {
+        log_file << GenerateNetworkRecap() << std::endl;
         log_file.close();
     }
     if (binary_file.is_open())
@@ -764,6 +795,16 @@ void Logger::LogConsume()
     }
 }
 
+void Logger::AppendLineHeader(const LogItem& item)
+{
+    log_buffer.AppendTimestamp(std::chrono::duration_cast<std::chrono::milliseconds>(item.date - start_time).count());
+    log_buffer.Append(' ');
+    log_buffer.Append(ConnectionStateToString(item.connection_state));
+    log_buffer.Append(' ');
+    log_buffer.Append(OriginToString(item.origin));
+    log_buffer.Append(' ');
+}
+
 void Logger::LoadConfig()
 {
     std::time_t modification_time = Conf::GetModifiedTimestamp();
@@ -797,6 +838,7 @@ void Logger::LoadConfig()
     log_network_recap_console = conf.contains(Conf::network_recap_to_console_key) && conf[Conf::network_recap_to_console_key].get<bool>();
     log_raw_bytes = conf.contains(Conf::raw_bytes_log_key) && conf[Conf::raw_bytes_log_key].get<bool>();
     log_to_binary_file = conf.contains(Conf::binary_file_log_key) && conf[Conf::binary_file_log_key].get<bool>();
+    capture_compression_level = conf[Conf::capture_compression_level_key].get_number<int>();
 #ifdef WITH_GUI
     in_gui = !Conf::headless;
 #endif
@@ -816,6 +858,31 @@ void Logger::LoadConfig()
         }
     }
 
+    // Publish the skippable packets before bumping the version, so anyone
+    // seeing the new version also gets the matching snapshot
+    std::shared_ptr<SkippablePacketsMap> skippable = std::make_shared<SkippablePacketsMap>();
+    // Binary file and GUI keep all the packets, even the ignored ones
+    if (!log_to_binary_file
+#ifdef WITH_GUI
+        && !in_gui
+#endif
+        )
+    {
+        std::scoped_lock lock(ignored_packets_mutex);
+        for (const auto& [key, ignored_set] : ignored_packets)
+        {
+            std::set<int>& skippable_set = (*skippable)[key];
+            skippable_set = ignored_set;
+            // Custom payload names depend on their content, so
+            // we need to parse them to keep the network recap exact
+            for (const int id : GetCustomPayloadIds(key.first, key.second == Endpoint::Server))
+            {
+                skippable_set.erase(id);
+            }
+        }
+    }
+    std::atomic_store(&skippable_packets, std::shared_ptr<const SkippablePacketsMap>(std::move(skippable)));
+
 #ifdef WITH_GUI
     // Rewrite filtered packet history with updated ignored lists
     if (in_gui)
@@ -823,6 +890,7 @@ void Logger::LoadConfig()
         UpdateFilteredPackets();
     }
 #endif
+    conf_version += 1;
     std::cout << "Conf file loaded from " << Conf::conf_path << std::endl;
 }
 
@@ -934,6 +1002,91 @@ int GetIdFromName(const std::string& name, const ConnectionState connection_stat
     return -1;
 }
 
+template <typename Tuple>
+std::string_view GetNameFromId(const int id)
+{
+    const auto& name_ids = PacketNameIdExtractor<Tuple>::name_ids;
+    if (id < 0 || id >= static_cast<int>(name_ids.size()))
+    {
+        return "";
+    }
+    return name_ids[id].name;
+}
+
+std::string_view GetNameFromId(const int id, const ConnectionState connection_state, const bool clientbound)
+{
+    if (clientbound)
+    {
+        switch (connection_state)
+        {
+        case ConnectionState::Status:
+            return GetNameFromId<AllClientboundStatusPackets>(id);
+        case ConnectionState::Login:
+            return GetNameFromId<AllClientboundLoginPackets>(id);
+        case ConnectionState::Play:
+            return GetNameFromId<AllClientboundPlayPackets>(id);
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+        case ConnectionState::Configuration:
+            return GetNameFromId<AllClientboundConfigurationPackets>(id);
+#endif
+        default:
+            return "";
+        }
+    }
+    else
+    {
+        switch (connection_state)
+        {
+        case ConnectionState::Handshake:
+            return GetNameFromId<AllServerboundHandshakingPackets>(id);
+        case ConnectionState::Status:
+            return GetNameFromId<AllServerboundStatusPackets>(id);
+        case ConnectionState::Login:
+            return GetNameFromId<AllServerboundLoginPackets>(id);
+        case ConnectionState::Play:
+            return GetNameFromId<AllServerboundPlayPackets>(id);
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+        case ConnectionState::Configuration:
+            return GetNameFromId<AllServerboundConfigurationPackets>(id);
+#endif
+        default:
+            return "";
+        }
+    }
+}
+
+std::vector<int> GetCustomPayloadIds(const ConnectionState connection_state, const bool clientbound)
+{
+    // Must match the packets with a special name in Logger::GetPacketName
+    switch (connection_state)
+    {
+    case ConnectionState::Play:
+        if (clientbound)
+        {
+            return { Internal::get_tuple_index<ClientboundCustomPayloadPacket, AllClientboundPlayPackets> };
+        }
+        return { Internal::get_tuple_index<ServerboundCustomPayloadPacket, AllServerboundPlayPackets> };
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+    case ConnectionState::Configuration:
+        if (clientbound)
+        {
+            return { Internal::get_tuple_index<ClientboundCustomPayloadConfigurationPacket, AllClientboundConfigurationPackets> };
+        }
+        return { Internal::get_tuple_index<ServerboundCustomPayloadConfigurationPacket, AllServerboundConfigurationPackets> };
+#endif
+#if PROTOCOL_VERSION > 340 /* > 1.12.2 */
+    case ConnectionState::Login:
+        if (clientbound)
+        {
+            return { Internal::get_tuple_index<ClientboundCustomQueryPacket, AllClientboundLoginPackets> };
+        }
+        return {};
+#endif
+    default:
+        return {};
+    }
+}
+
 void Logger::LoadPacketsFromJson(const Json::Value& value, const ConnectionState connection_state)
 {
     ignored_packets[{connection_state, Endpoint::Client}] = std::set<int>();
@@ -1067,21 +1220,32 @@ std::string_view Logger::ConnectionStateToString(const ConnectionState connectio
 }
 
 std::string Logger::GetPacketName(const LogItem& item) const
+{
+    std::string packet_name;
+    GetPacketName(item, packet_name);
+    return packet_name;
+}
+
+void Logger::GetPacketName(const LogItem& item, std::string& packet_name) const
 {
     const Endpoint simple_origin = SimpleOrigin(item.origin);
-    const std::string packet_name(item.packet->GetName());
+    packet_name.assign(item.packet->GetName());
     switch (item.connection_state)
     {
     case ConnectionState::Play:
         if (simple_origin == Endpoint::Server && item.packet->GetId() == Internal::get_tuple_index<ClientboundCustomPayloadPacket, AllClientboundPlayPackets>)
         {
             std::shared_ptr<ClientboundCustomPayloadPacket> custom_payload = std::dynamic_pointer_cast<ClientboundCustomPayloadPacket>(item.packet);
-            return packet_name + '|' + custom_payload->GetIdentifier();
+            packet_name += '|';
+            packet_name += custom_payload->GetIdentifier();
+            return;
         }
         else if (simple_origin == Endpoint::Client && item.packet->GetId() == Internal::get_tuple_index<ServerboundCustomPayloadPacket, AllServerboundPlayPackets>)
         {
             std::shared_ptr<ServerboundCustomPayloadPacket> custom_payload = std::dynamic_pointer_cast<ServerboundCustomPayloadPacket>(item.packet);
-            return packet_name + '|' + custom_payload->GetIdentifier();
+            packet_name += '|';
+            packet_name += custom_payload->GetIdentifier();
+            return;
         }
         break;
 #if PROTOCOL_VERSION > 763 /* > 1.20.1 */
@@ -1089,12 +1253,16 @@ std::string Logger::GetPacketName(const LogItem& item) const
         if (simple_origin == Endpoint::Server && item.packet->GetId() == Internal::get_tuple_index<ClientboundCustomPayloadConfigurationPacket, AllClientboundConfigurationPackets>)
         {
             std::shared_ptr<ClientboundCustomPayloadConfigurationPacket> custom_payload = std::dynamic_pointer_cast<ClientboundCustomPayloadConfigurationPacket>(item.packet);
-            return packet_name + '|' + custom_payload->GetIdentifier();
+            packet_name += '|';
+            packet_name += custom_payload->GetIdentifier();
+            return;
         }
         else if (simple_origin == Endpoint::Client && item.packet->GetId() == Internal::get_tuple_index<ServerboundCustomPayloadConfigurationPacket, AllServerboundConfigurationPackets>)
         {
             std::shared_ptr<ServerboundCustomPayloadConfigurationPacket> custom_payload = std::dynamic_pointer_cast<ServerboundCustomPayloadConfigurationPacket>(item.packet);
-            return packet_name + '|' + custom_payload->GetIdentifier();
+            packet_name += '|';
+            packet_name += custom_payload->GetIdentifier();
+            return;
         }
         break;
 #endif
@@ -1103,14 +1271,15 @@ std::string Logger::GetPacketName(const LogItem& item) const
         if (simple_origin == Endpoint::Server && item.packet->GetId() == Internal::get_tuple_index<ClientboundCustomQueryPacket, AllClientboundLoginPackets>)
         {
             std::shared_ptr<ClientboundCustomQueryPacket> custom_payload = std::dynamic_pointer_cast<ClientboundCustomQueryPacket>(item.packet);
-            return packet_name + '|' + custom_payload->GetIdentifier().GetFull();
+            packet_name += '|';
+            packet_name += custom_payload->GetIdentifier().GetFull();
+            return;
         }
         break;
 #endif
     default:
         break;
     }
-    return packet_name;
 }
 
 Endpoint Logger::SimpleOrigin(const Endpoint origin) const
@@ -1133,6 +1302,20 @@ Endpoint Logger::SimpleOrigin(const Endpoint origin) const
     }
 }
 
+void Logger::UpdateNetworkRecap(const std::string& packet_name, const Endpoint origin, const size_t bandwidth_bytes)
+{
+    std::scoped_lock lock(network_recap_mutex);
+    std::map<std::string, NetworkRecapItem>& recap_data_map = origin == Endpoint::Server ? clientbound_network_recap_data : serverbound_network_recap_data;
+
+    NetworkRecapItem& recap = recap_data_map[packet_name];
+    recap.count += 1;
+    recap.bandwidth_bytes += bandwidth_bytes;
+
+    NetworkRecapItem& total_recap_item = origin == Endpoint::Server ? clientbound_total_network_recap : serverbound_total_network_recap;
+    total_recap_item.count += 1;
+    total_recap_item.bandwidth_bytes += bandwidth_bytes;
+}
+
 using map_it = std::map<std::string, NetworkRecapItem>::const_iterator;
 std::string ReportTable(
     const NetworkRecapItem& clientbound_total,
@@ -1560,6 +1743,10 @@ std::string Logger::GenerateNetworkRecap(const int max_entry, const int max_name
         output << "Sorted by bandwidth:\n";
     }
     output << ReportTable(clientbound_total_network_recap, serverbound_total_network_recap, clientbound_recap_iterators_sorted_size, serverbound_recap_iterators_sorted_size, max_entry, max_name_size);
+    output << "\nWrite queue (current/max bytes): Server --> Client " << clientbound_write_queue_bytes << "/" << clientbound_max_write_queue_bytes
+        << " | Client --> Server " << serverbound_write_queue_bytes << "/" << serverbound_max_write_queue_bytes << "\n";
+    const PacketPoolStats packet_pool_stats = GetPacketPoolStats();
+    output << "Packet pool (heap allocations/reused): " << packet_pool_stats.heap_allocations << "/" << packet_pool_stats.reused_allocations << "\n";
 
     return output.str();
 }
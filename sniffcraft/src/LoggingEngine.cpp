@@ -0,0 +1,371 @@
+#include "sniffcraft/conf.hpp"
+#include "sniffcraft/LoggingEngine.hpp"
+
+#include <algorithm>
+
+LogSession::LogSession()
+{
+    session_id = 0;
+    worker_index = 0;
+    opened = false;
+    close_requested = false;
+    closed = false;
+    pending_flush = false;
+    released = false;
+}
+
+LogSession::~LogSession()
+{
+
+}
+
+void LogSession::OpenSession()
+{
+    LoggingEngine& engine = LoggingEngine::GetInstance();
+    engine.Register(*this);
+    // Let the worker know about this session even if it never receives any item
+    engine.Push(*this, LoggingEngine::RecordType::Open, LogItem{});
+    opened = true;
+}
+
+void LogSession::PushRecord(LogItem&& item)
+{
+    LoggingEngine& engine = LoggingEngine::GetInstance();
+    engine.Push(*this, LoggingEngine::RecordType::Item, std::move(item));
+    engine.Wake(*this);
+}
+
+void LogSession::PushRecords(std::vector<LogItem>&& items)
+{
+    if (items.empty())
+    {
+        return;
+    }
+
+    LoggingEngine& engine = LoggingEngine::GetInstance();
+    for (LogItem& item : items)
+    {
+        engine.Push(*this, LoggingEngine::RecordType::Item, std::move(item));
+    }
+    engine.Wake(*this);
+}
+
+void LogSession::CloseSession()
+{
+    if (!opened || close_requested.exchange(true))
+    {
+        return;
+    }
+
+    LoggingEngine& engine = LoggingEngine::GetInstance();
+    engine.Push(*this, LoggingEngine::RecordType::Close, LogItem{});
+    engine.Wake(*this);
+}
+
+void LogSession::ReleaseSession()
+{
+    if (!opened)
+    {
+        return;
+    }
+
+    // Nobody else can push records for this session anymore, once
+    // the release record is processed the worker won't use it again
+    LoggingEngine& engine = LoggingEngine::GetInstance();
+    engine.Push(*this, LoggingEngine::RecordType::Release, LogItem{});
+    engine.Wake(*this);
+
+    std::unique_lock<std::mutex> lock(released_mutex);
+    released_condition.wait(lock, [this]() { return released; });
+    opened = false;
+}
+
+void LogSession::OnBatchEnd()
+{
+
+}
+
+void LogSession::Flush()
+{
+
+}
+
+LoggingEngine& LoggingEngine::GetInstance()
+{
+    static LoggingEngine instance;
+    return instance;
+}
+
+unsigned int LoggingEngine::GetConfGeneration() const
+{
+    return conf_generation;
+}
+
+LoggingEngine::Worker::Worker() : queue(LOGGING_QUEUE_SIZE)
+{
+
+}
+
+LoggingEngine::LoggingEngine()
+{
+    unsigned int workers_count = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(Conf::conf_mutex);
+        const ProtocolCraft::Json::Value conf = Conf::LoadConf();
+        workers_count = conf[Conf::logging_threads_key].get_number<unsigned int>();
+        last_time_conf_file_modified = Conf::GetModifiedTimestamp();
+    }
+    // Writing logs is mostly waiting for the disk, a few workers are enough for many sessions
+    if (workers_count == 0)
+    {
+        workers_count = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+    }
+
+    is_running = true;
+    next_session_id = 0;
+    conf_generation = 0;
+    last_time_checked_conf_file = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+    workers.reserve(workers_count);
+    for (unsigned int i = 0; i < workers_count; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (std::unique_ptr<Worker>& worker : workers)
+    {
+        worker->thread = std::thread(&LoggingEngine::Work, this, std::ref(*worker));
+    }
+
+    reaper_running = true;
+    reaper_thread = std::thread(&LoggingEngine::Reap, this);
+}
+
+LoggingEngine::~LoggingEngine()
+{
+    // Destroy the last retired sessions first, they need the workers to be released
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        reaper_running = false;
+    }
+    retired_condition.notify_all();
+    if (reaper_thread.joinable())
+    {
+        reaper_thread.join();
+    }
+
+    // All the sessions have been released, workers only have to exit
+    is_running = false;
+    for (std::unique_ptr<Worker>& worker : workers)
+    {
+        worker->queue.Interrupt();
+    }
+    for (std::unique_ptr<Worker>& worker : workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+void LoggingEngine::Register(LogSession& session)
+{
+    session.session_id = next_session_id++;
+    session.worker_index = session.session_id % workers.size();
+}
+
+void LoggingEngine::Push(LogSession& session, const RecordType type, LogItem&& item)
+{
+    workers[session.worker_index]->queue.Push({ &session, type, std::move(item) });
+}
+
+void LoggingEngine::Wake(const LogSession& session)
+{
+    workers[session.worker_index]->queue.WakeConsumer();
+}
+
+void LoggingEngine::Work(Worker& worker)
+{
+    std::vector<Record> records;
+    std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last_idle_check = last_flush;
+    while (true)
+    {
+        // Take everything available at once
+        if (worker.queue.PopAll(records) == 0)
+        {
+            // Stop only once everything has been processed, records
+            // pushed right before stopping are visible once it's seen
+            if (!is_running)
+            {
+                if (worker.queue.Empty())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            // Nothing else to process for now, don't keep data waiting
+            FlushSessions(worker);
+            last_flush = std::chrono::steady_clock::now();
+            // Wake up regularly even without any record, idle sessions still have to see conf changes
+            if (!worker.queue.WaitForItems(is_running, LOG_IDLE_CHECK_INTERVAL))
+            {
+                CheckIdleSessions(worker);
+                last_idle_check = std::chrono::steady_clock::now();
+            }
+            continue;
+        }
+
+        for (Record& record : records)
+        {
+            LogSession& session = *record.session;
+            switch (record.type)
+            {
+            case RecordType::Open:
+                worker.open_sessions.push_back(&session);
+                break;
+            case RecordType::Item:
+                if (session.closed)
+                {
+                    break;
+                }
+                session.Consume(record.item);
+                if (!session.pending_flush)
+                {
+                    session.pending_flush = true;
+                    worker.active_sessions.push_back(&session);
+                }
+                break;
+            case RecordType::Close:
+                CloseSession(worker, session);
+                break;
+            case RecordType::Release:
+                CloseSession(worker, session);
+                {
+                    // Notify with the lock held, the session can be destroyed as soon as it's released
+                    std::lock_guard<std::mutex> lock(session.released_mutex);
+                    session.released = true;
+                    session.released_condition.notify_all();
+                }
+                break;
+            }
+        }
+        // Release the packets now, keeping the vector capacity for the next batch
+        records.clear();
+
+        PollConfFile();
+        for (LogSession* session : worker.active_sessions)
+        {
+            session->OnBatchEnd();
+        }
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        // A busy worker may never time out waiting, but some of its sessions can still be idle
+        if (now - last_idle_check > LOG_IDLE_CHECK_INTERVAL)
+        {
+            CheckIdleSessions(worker);
+            last_idle_check = now;
+        }
+        if (now - last_flush > LOG_FLUSH_INTERVAL)
+        {
+            FlushSessions(worker);
+            last_flush = now;
+        }
+    }
+}
+
+void LoggingEngine::CloseSession(Worker& worker, LogSession& session)
+{
+    if (session.closed)
+    {
+        return;
+    }
+
+    session.closed = true;
+    const std::vector<LogSession*>::iterator it = std::find(worker.open_sessions.begin(), worker.open_sessions.end(), &session);
+    if (it != worker.open_sessions.end())
+    {
+        worker.open_sessions.erase(it);
+    }
+    if (session.pending_flush)
+    {
+        session.pending_flush = false;
+        worker.active_sessions.erase(std::find(worker.active_sessions.begin(), worker.active_sessions.end(), &session));
+    }
+    session.OnClose();
+}
+
+void LoggingEngine::FlushSessions(Worker& worker)
+{
+    for (LogSession* session : worker.active_sessions)
+    {
+        session->Flush();
+        session->pending_flush = false;
+    }
+    worker.active_sessions.clear();
+}
+
+void LoggingEngine::CheckIdleSessions(Worker& worker)
+{
+    PollConfFile();
+    for (LogSession* session : worker.open_sessions)
+    {
+        // Sessions with pending data already had their OnBatchEnd call for this batch
+        if (!session->pending_flush)
+        {
+            session->OnBatchEnd();
+        }
+    }
+}
+
+void LoggingEngine::PollConfFile()
+{
+    const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::time_t last_check = last_time_checked_conf_file;
+    // Only one worker does the check
+    if (now - last_check <= 5 || !last_time_checked_conf_file.compare_exchange_strong(last_check, now))
+    {
+        return;
+    }
+
+    const std::time_t modification_time = Conf::GetModifiedTimestamp();
+    if (modification_time != -1 && last_time_conf_file_modified.exchange(modification_time) != modification_time)
+    {
+        // Sessions reload their conf after their next batch or idle check
+        conf_generation += 1;
+    }
+}
+
+void LoggingEngine::Retire(LogSession* session)
+{
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        retired_sessions.push_back(session);
+    }
+    retired_condition.notify_all();
+}
+
+void LoggingEngine::Reap()
+{
+    std::vector<LogSession*> sessions;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(retired_mutex);
+            retired_condition.wait(lock, [this]() { return !reaper_running || !retired_sessions.empty(); });
+            if (retired_sessions.empty())
+            {
+                break;
+            }
+            std::swap(sessions, retired_sessions);
+        }
+
+        // Each destructor waits for its worker and can finalize files, keep that away from the network threads
+        for (LogSession* session : sessions)
+        {
+            delete session;
+        }
+        sessions.clear();
+    }
+}
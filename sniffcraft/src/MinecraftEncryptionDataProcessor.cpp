@@ -1,24 +1,90 @@
 #ifdef USE_ENCRYPTION
-#include <botcraft/Network/AESEncrypter.hpp>
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
 
 #include "sniffcraft/MinecraftEncryptionDataProcessor.hpp"
 
-MinecraftEncryptionDataProcessor::MinecraftEncryptionDataProcessor(std::unique_ptr<Botcraft::AESEncrypter>& encrypter_)
+MinecraftEncryptionDataProcessor::MinecraftEncryptionDataProcessor(const std::vector<unsigned char>& shared_secret)
 {
-    encrypter = std::move(encrypter_);
+    encryption_context = EVP_CIPHER_CTX_new();
+    decryption_context = EVP_CIPHER_CTX_new();
+
+    // Minecraft uses the shared secret as both key and IV
+    if (shared_secret.size() != 16 ||
+        encryption_context == nullptr || decryption_context == nullptr ||
+        EVP_EncryptInit_ex(encryption_context, EVP_aes_128_cfb8(), nullptr, shared_secret.data(), shared_secret.data()) != 1 ||
+        // CFB decryption uses the block cipher in encryption direction
+        EVP_EncryptInit_ex(decryption_context, EVP_aes_128_ecb(), nullptr, shared_secret.data(), nullptr) != 1 ||
+        EVP_CIPHER_CTX_set_padding(decryption_context, 0) != 1)
+    {
+        EVP_CIPHER_CTX_free(encryption_context);
+        EVP_CIPHER_CTX_free(decryption_context);
+        throw std::runtime_error("Error initializing encryption contexts");
+    }
+
+    std::memcpy(decryption_ciphertext.data(), shared_secret.data(), 16);
+    decryption_registers = std::vector<unsigned char>(16 * DECRYPTION_BATCH_SIZE);
+    decryption_keystream = std::vector<unsigned char>(16 * DECRYPTION_BATCH_SIZE);
 }
 
 MinecraftEncryptionDataProcessor::~MinecraftEncryptionDataProcessor()
 {
+    EVP_CIPHER_CTX_free(encryption_context);
+    EVP_CIPHER_CTX_free(decryption_context);
 }
 
-std::vector<unsigned char> MinecraftEncryptionDataProcessor::ProcessIncomingData(const std::vector<unsigned char>& data) const
+void MinecraftEncryptionDataProcessor::ProcessIncomingData(unsigned char* const data, const size_t length)
 {
-    return encrypter->Decrypt(data);
+    // In CFB8, plaintext[i] = ciphertext[i] ^ AES(register[i])[0], where register[i] is
+    // the 16 ciphertext bytes (or IV) preceding byte i. All registers are known before
+    // decrypting, so all the AES blocks of a batch can be computed with one ECB call,
+    // letting OpenSSL pipeline them with AES-NI instead of running one block at a time
+    size_t processed = 0;
+    while (processed < length)
+    {
+        const size_t batch_size = std::min(length - processed, DECRYPTION_BATCH_SIZE);
+        unsigned char* const batch = data + processed;
+
+        // Keep a copy of the ciphertext after the current register as it's overwritten in place
+        std::memcpy(decryption_ciphertext.data() + 16, batch, batch_size);
+        for (size_t i = 0; i < batch_size; ++i)
+        {
+            std::memcpy(decryption_registers.data() + 16 * i, decryption_ciphertext.data() + i, 16);
+        }
+
+        int out_length = 0;
+        if (EVP_EncryptUpdate(decryption_context, decryption_keystream.data(), &out_length, decryption_registers.data(), static_cast<int>(16 * batch_size)) != 1)
+        {
+            throw std::runtime_error("Error decrypting data");
+        }
+
+        for (size_t i = 0; i < batch_size; ++i)
+        {
+            batch[i] = decryption_ciphertext[16 + i] ^ decryption_keystream[16 * i];
+        }
+
+        // The register for the next batch is the last 16 ciphertext bytes
+        std::memmove(decryption_ciphertext.data(), decryption_ciphertext.data() + batch_size, 16);
+        processed += batch_size;
+    }
 }
 
-std::vector<unsigned char> MinecraftEncryptionDataProcessor::ProcessOutgoingData(const std::vector<unsigned char>& data) const
+void MinecraftEncryptionDataProcessor::ProcessOutgoingData(unsigned char* const data, const size_t length)
 {
-    return encrypter->Encrypt(data);
+    size_t processed = 0;
+    while (processed < length)
+    {
+        const int chunk_size = static_cast<int>(std::min(length - processed, static_cast<size_t>(INT_MAX)));
+        int out_length = 0;
+        if (EVP_EncryptUpdate(encryption_context, data + processed, &out_length, data + processed, chunk_size) != 1)
+        {
+            throw std::runtime_error("Error encrypting data");
+        }
+        processed += chunk_size;
+    }
 }
 #endif
@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
+#include <tuple>
 
+#include <protocolCraft/AllPackets.hpp>
 #include <protocolCraft/BinaryReadWrite.hpp>
 #include <protocolCraft/PacketFactory.hpp>
 #include <protocolCraft/Utilities/Json.hpp>
@@ -16,8 +19,11 @@
 
 #include "sniffcraft/Compression.hpp"
 #include "sniffcraft/conf.hpp"
+#include "sniffcraft/Framing.hpp"
 #include "sniffcraft/MinecraftProxy.hpp"
 #include "sniffcraft/Logger.hpp"
+#include "sniffcraft/LogItem.hpp"
+#include "sniffcraft/PacketPool.hpp"
 #include "sniffcraft/ReplayModLogger.hpp"
 #ifdef USE_ENCRYPTION
 #include "sniffcraft/MinecraftEncryptionDataProcessor.hpp"
@@ -28,10 +34,19 @@ using namespace ProtocolCraft;
 MinecraftProxy::MinecraftProxy(
     asio::io_context& io_context,
     std::function<void(const std::string&, const int)> transfer_callback_
-) : BaseProxy(io_context)
+) : BaseProxy(io_context), parsing_strand(asio::make_strand(io_context))
 {
     connection_state = ConnectionState::Handshake;
     compression_threshold = -1;
+    transmit_original_clientbound_packet = true;
+    transmit_original_serverbound_packet = true;
+    client_parsing_needed_conf_version = 0;
+    server_parsing_needed_conf_version = 0;
+    cut_through_threshold = 0;
+    forward_first = false;
+    client_decompressor = std::make_shared<Decompressor>();
+    server_decompressor = std::make_shared<Decompressor>();
+    deferred_decompressor = std::make_shared<Decompressor>();
 
 #if PROTOCOL_VERSION > 765 /* > 1.20.4 */
     // If it's a version with transfer packet, store the callback
@@ -41,40 +56,75 @@ MinecraftProxy::MinecraftProxy(
 
 MinecraftProxy::~MinecraftProxy()
 {
-    if (logger != nullptr)
+    if (logger != nullptr && forward_first)
+    {
+        // Stop once all the deferred packets have been logged
+        asio::post(parsing_strand, [logger = logger]() { logger->Stop(); });
+    }
+    else if (logger != nullptr)
     {
         logger->Stop();
     }
 }
 
-std::optional<std::string> MinecraftProxy::Start(const std::string& server_address, const unsigned short server_port)
+void MinecraftProxy::Start(const std::string& server_address, const unsigned short server_port, const std::function<void(const std::optional<std::string>&)>& callback)
 {
-    logger = std::make_shared<Logger>();
+    logger = LoggingEngine::MakeSession<Logger>();
 
     std::shared_lock<std::shared_mutex> lock(Conf::conf_mutex);
     const ProtocolCraft::Json::Value conf = Conf::LoadConf();
     if (conf.contains(Conf::replay_log_key) && conf[Conf::replay_log_key].get<bool>())
     {
-        replay_logger = std::make_unique<ReplayModLogger>();
+        replay_logger = LoggingEngine::MakeSession<ReplayModLogger>();
         replay_logger->SetServerName(server_address + ":" + std::to_string(server_port));
     }
 
+    client_connection.SetMaxReadBufferSize(conf[Conf::max_read_buffer_size_key].get_number<size_t>());
+    server_connection.SetMaxReadBufferSize(conf[Conf::max_read_buffer_size_key].get_number<size_t>());
+    client_connection.SetWriteWatermarks(conf[Conf::write_high_watermark_key].get_number<size_t>(), conf[Conf::write_low_watermark_key].get_number<size_t>());
+    server_connection.SetWriteWatermarks(conf[Conf::write_high_watermark_key].get_number<size_t>(), conf[Conf::write_low_watermark_key].get_number<size_t>());
+    cut_through_threshold = conf[Conf::cut_through_threshold_key].get_number<size_t>();
+    forward_first = conf[Conf::forward_first_key].get<bool>();
+    wire_compressor = std::make_unique<Compressor>(conf[Conf::wire_compression_level_key].get_number<int>());
+
 #ifdef USE_ENCRYPTION
     if (conf.contains(Conf::online_key) && conf[Conf::online_key].get<bool>())
     {
-        authentifier = std::make_unique<Botcraft::Authentifier>();
+        // Authentication is done once connected to the server, in OnServerConnected
+        authentifier = std::make_shared<Botcraft::Authentifier>();
+        credentials_cache_key = conf.contains(Conf::account_cache_key_key) ? conf[Conf::account_cache_key_key].get<std::string>() : "";
+    }
+#endif
 
-        const std::string credentials_cache_key = conf.contains(Conf::account_cache_key_key) ? conf[Conf::account_cache_key_key].get<std::string>() : "";
+    BaseProxy::Start(server_address, server_port, callback);
+}
 
+void MinecraftProxy::OnServerConnected(const std::function<void(const std::optional<std::string>&)>& done)
+{
+#ifdef USE_ENCRYPTION
+    if (authentifier != nullptr)
+    {
+        BeginStartStage("Microsoft authentication", AUTHENTICATION_TIMEOUT);
         std::cout << "Trying to authenticate using Microsoft account" << std::endl;
-        if (!authentifier->AuthMicrosoft(credentials_cache_key))
-        {
-            return "Error trying to authenticate with Microsoft account";
-        }
+        // Authentication is blocking and can't be cancelled, run it on its own detached thread
+        // to never stall the network threads nor the destruction of this proxy. It only owns
+        // what it needs, and only uses this proxy if it's still alive once done
+        std::thread([this, weak_this = weak_from_this(), auth = authentifier, cache_key = credentials_cache_key, done]() {
+            const bool success = auth->AuthMicrosoft(cache_key);
+            const std::shared_ptr<BaseProxy> self = weak_this.lock();
+            // If the start sequence has been aborted, the proxy might be destroyed soon
+            if (self == nullptr || !Running())
+            {
+                return;
+            }
+            asio::post(strand, [self, done, success]() {
+                done(success ? std::nullopt : std::optional<std::string>("Error trying to authenticate with Microsoft account"));
+            });
+        }).detach();
+        return;
     }
 #endif
-
-    return BaseProxy::Start(server_address, server_port);
+    done(std::nullopt);
 }
 
 std::shared_ptr<Logger> MinecraftProxy::GetLogger() const
@@ -85,67 +135,136 @@ std::shared_ptr<Logger> MinecraftProxy::GetLogger() const
 size_t MinecraftProxy::ProcessData(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source)
 {
     Connection& dst_connection = source == Endpoint::Server ? client_connection : server_connection;
+    logger->UpdateWriteQueueDepth(source, dst_connection.GetPendingWriteBytes());
 
-    std::vector<unsigned char>::const_iterator data_iterator = data;
-    size_t max_length = length;
-
-    const size_t packet_length = Peek(data_iterator, max_length);
-    const size_t packet_length_length = length - max_length;
-
-    // We don't have enough data to get packet size
-    if (packet_length == 0)
+    size_t processed = 0;
+    // A packet is being forwarded before being fully received, send the new bytes
+    if ((source == Endpoint::Server ? server_cut_through : client_cut_through).remaining_bytes > 0)
     {
-        return 0;
+        processed = ContinueCutThrough(data, length, source);
     }
-    // We don't have enough data to get a full packet
-    if (packet_length > max_length)
+    else
     {
-        return 0;
+        // Logger conf has been reloaded since last time, update the list of packets we need to parse
+        if (logger->GetConfVersion() != (source == Endpoint::Server ? server_parsing_needed_conf_version : client_parsing_needed_conf_version))
+        {
+            UpdateParsingNeeded(source);
+        }
+
+        // Find all the complete packets with a single scan, and process them all
+        std::vector<Frame>& frames = source == Endpoint::Server ? server_frames : client_frames;
+        FindCompleteFrames(&(*data), length, frames);
+        for (const Frame& frame : frames)
+        {
+            ProcessPacket(data + processed, frame, source);
+            processed += frame.length_size + frame.packet_size;
+            // The other side can't keep up, or a handler paused this lane, stop here
+            if (dst_connection.IsWriteQueueFull() || IsLanePaused(source))
+            {
+                break;
+            }
+        }
+
+        // We don't have enough data to get a full packet, forward
+        // what we already have if it's big enough and not handled
+        if (frames.empty())
+        {
+            int packet_length = 0;
+            const size_t packet_length_length = ReadVarIntNoThrow(&(*data), length, packet_length);
+            if (packet_length_length > 0 && packet_length > 0)
+            {
+                processed = StartCutThrough(data, length, packet_length + packet_length_length, source);
+            }
+        }
     }
 
-    size_t remaining_packet_bytes = packet_length;
-    std::vector<unsigned char> uncompressed;
+    // Send all the logs of this batch at once
+    FlushPendingLogs(source);
+
+    return processed;
+}
+
+void MinecraftProxy::ProcessPacket(const std::vector<unsigned char>::const_iterator& data, const Frame& frame, const Endpoint source)
+{
+    Connection& dst_connection = source == Endpoint::Server ? client_connection : server_connection;
+    const size_t packet_size = frame.length_size + frame.packet_size;
+
+    // Read the shared state once, it can't change for this packet as
+    // the other lane can't receive anything depending on it before this packet is forwarded
+    const ConnectionState packet_connection_state = connection_state;
+
+    std::vector<unsigned char>::const_iterator data_iterator = data + frame.length_size;
+    size_t remaining_packet_bytes = frame.packet_size;
+    Decompressor& decompressor = source == Endpoint::Server ? *server_decompressor : *client_decompressor;
+    // Size of the uncompressed packet data, 0 if not compressed
+    int data_length = 0;
     if (compression_threshold > -1)
     {
-        const int data_length = ReadData<VarInt>(data_iterator, remaining_packet_bytes);
-        if (data_length != 0)
+        data_length = ReadData<VarInt>(data_iterator, remaining_packet_bytes);
+        // The decompression buffer is sized from this value, don't trust the peer with it
+        if (!IsValidDataLength(data_length, compression_threshold))
         {
-            uncompressed = Decompress(&(*data_iterator), remaining_packet_bytes);
-            data_iterator = uncompressed.begin();
-            remaining_packet_bytes = uncompressed.size();
+            std::cout << ((source == Endpoint::Server) ? "Server --> Client: " : "Client --> Server: ") <<
+                "INVALID DATA LENGTH " << data_length << " (compression threshold: " << compression_threshold << ")" << std::endl;
+            dst_connection.WriteData(ShareData(data, packet_size, source));
+            return;
         }
     }
 
-    const int minecraft_id = ReadData<VarInt>(data_iterator, remaining_packet_bytes);
-
-    std::shared_ptr<Packet> packet = source == Endpoint::Client ?
-        CreateServerboundPacket(connection_state, minecraft_id) :
-        CreateClientboundPacket(connection_state, minecraft_id);
-
-    // Clear the replacement bytes vector
-    bool error_parsing = false;
-    if (packet != nullptr)
+    // If some packets can be skipped in this state, or if some packets forwarded before
+    // being parsed have to be handled, read the id without decompressing the whole packet.
+    // For a compressed packet it's still an inflate, don't do it if nothing depends on the id
+    const std::map<ConnectionState, std::vector<bool>>& parsing_needed = source == Endpoint::Server ? server_parsing_needed : client_parsing_needed;
+    const auto parsing_needed_it = parsing_needed.find(packet_connection_state);
+    const bool has_skippable_packets = parsing_needed_it != parsing_needed.end() && !parsing_needed_it->second.empty();
+    // An empty packet will fail to parse, let the lane deal with it now
+    bool forward_before_parsing = forward_first && remaining_packet_bytes > 0;
+    if (has_skippable_packets || (forward_before_parsing && HasHandledPackets(packet_connection_state, source)))
     {
-        try
+        int peeked_id = -1;
+        if (remaining_packet_bytes == 0)
         {
-            packet->Read(data_iterator, remaining_packet_bytes);
+            // Empty packet, will fail to parse
         }
-        catch (const std::exception& ex)
+        else if (data_length != 0)
         {
-            std::cout << ((source == Endpoint::Server) ? "Server --> Client: " : "Client --> Server: ") <<
-                "PARSING EXCEPTION for message " << packet->GetName() << "(: " << minecraft_id << ")" << ex.what() << std::endl;
-            error_parsing = true;
+            // A VarInt is at most 5 bytes long
+            const std::vector<unsigned char>& head = decompressor.DecompressHead(&(*data_iterator), remaining_packet_bytes, 5);
+            ReadVarIntNoThrow(head.data(), head.size(), peeked_id);
+        }
+        else
+        {
+            ReadVarIntNoThrow(&(*data_iterator), remaining_packet_bytes, peeked_id);
+        }
+
+        if (!IsParsingNeeded(packet_connection_state, source, peeked_id))
+        {
+            logger->LogSkipped(packet_connection_state, source, peeked_id, packet_size);
+            dst_connection.WriteData(ShareData(data, packet_size, source));
+            return;
         }
+
+        // If its id can't be read it's malformed, let the lane deal with it now
+        forward_before_parsing = forward_before_parsing && peeked_id >= 0 && !IsHandledPacket(packet_connection_state, source, peeked_id);
     }
-    else
+
+    // Nothing can modify this packet, forward it right away and parse it later
+    if (forward_before_parsing)
     {
-        std::cout << ((source == Endpoint::Server) ? "Server --> Client: " : "Client --> Server: ") <<
-            "NULL MESSAGE WITH ID: " << minecraft_id << std::endl;
-        error_parsing = true;
+        // Copy before forwarding, as the forwarded bytes can be encrypted in place
+        PooledBuffer bytes = AcquireBuffer(packet_size);
+        bytes->insert(bytes->end(), data, data + packet_size);
+        dst_connection.WriteData(ShareData(data, packet_size, source));
+        ParseAndLog(std::move(bytes), packet_size - remaining_packet_bytes, data_length, packet_connection_state, source);
+        return;
     }
 
+    std::shared_ptr<Packet> packet = ParsePacket(data_iterator, remaining_packet_bytes, data_length, packet_connection_state, source, decompressor);
+    const bool error_parsing = packet == nullptr;
+
+    // Each lane has its own flag, as the handlers of both directions can run at the same time
+    bool& transmit_original_packet = source == Endpoint::Server ? transmit_original_clientbound_packet : transmit_original_serverbound_packet;
     transmit_original_packet = true;
-    const ConnectionState old_connection_state = connection_state;
     if (!error_parsing)
     {
         // React to the message if necessary
@@ -158,64 +277,360 @@ size_t MinecraftProxy::ProcessData(const std::vector<unsigned char>::const_itera
         // The packet is transmitted, log it as it is
         if (!error_parsing)
         {
-            logger->Log(packet, old_connection_state, source, packet_length + packet_length_length);
-            if (replay_logger)
-            {
-                replay_logger->Log(packet, old_connection_state, source);
-            }
+            LogPacket(source, packet, packet_connection_state, source, packet_size, true);
         }
 
-        dst_connection.WriteData(&(*data), packet_length + packet_length_length);
+        dst_connection.WriteData(ShareData(data, packet_size, source));
     }
     // The packet has been replaced by something else, log it as intercepted by sniffcraft
     else if (!error_parsing)
     {
         // The packet has been replaced, log it as intercepted by sniffcraft
-        logger->Log(packet, old_connection_state, source == Endpoint::Server ? Endpoint::ServerToSniffcraft : Endpoint::ClientToSniffcraft, packet_length + packet_length_length);
+        LogPacket(source, packet, packet_connection_state, source == Endpoint::Server ? Endpoint::ServerToSniffcraft : Endpoint::ClientToSniffcraft, packet_size);
     }
+}
 
-    // Return the number of bytes we read (or rather should have read in case of error)
-    return packet_length + packet_length_length;
+PooledBuffer MinecraftProxy::PacketToBytes(const Packet& packet)
+{
+    PooledBuffer content = AcquireBuffer(0);
+    packet.Write(*content);
+    const int content_size = static_cast<int>(content.size());
+    const int threshold = compression_threshold;
+
+    // Write the headers first and then the data, without inserting anything at the front
+    PooledBuffer sized_packet;
+    if (threshold > -1 && content_size >= threshold)
+    {
+        std::lock_guard<std::mutex> compressor_lock(wire_compressor_mutex);
+        const std::vector<unsigned char>& compressed_data = wire_compressor->Compress(content.data(), content.size());
+        const int packet_length = static_cast<int>(VarIntSize(content_size) + compressed_data.size());
+        sized_packet = AcquireBuffer(VarIntSize(packet_length) + packet_length);
+        WriteData<VarInt>(packet_length, *sized_packet);
+        WriteData<VarInt>(content_size, *sized_packet);
+        sized_packet->insert(sized_packet->end(), compressed_data.begin(), compressed_data.end());
+    }
+    else
+    {
+        // Below the threshold, packet is sent uncompressed with a 0 data length
+        const int packet_length = threshold > -1 ? content_size + 1 : content_size;
+        sized_packet = AcquireBuffer(VarIntSize(packet_length) + packet_length);
+        WriteData<VarInt>(packet_length, *sized_packet);
+        if (threshold > -1)
+        {
+            sized_packet->push_back(0x00);
+        }
+        sized_packet->insert(sized_packet->end(), content.cbegin(), content.cend());
+    }
+
+    return sized_packet;
 }
 
-size_t MinecraftProxy::Peek(std::vector<unsigned char>::const_iterator& data, size_t& length)
+void MinecraftProxy::UpdateParsingNeeded(const Endpoint source)
 {
-    try
+    const std::map<std::pair<ConnectionState, Endpoint>, std::set<int>>& handled_packets = GetHandledPackets();
+
+    std::map<ConnectionState, std::vector<bool>>& parsing_needed = source == Endpoint::Server ? server_parsing_needed : client_parsing_needed;
+    (source == Endpoint::Server ? server_parsing_needed_conf_version : client_parsing_needed_conf_version) = logger->GetConfVersion();
+    parsing_needed.clear();
+
+    // Replay logger needs all the clientbound packets
+    if (replay_logger != nullptr && source == Endpoint::Server)
+    {
+        return;
+    }
+
+    for (const ConnectionState state : {
+        ConnectionState::Handshake,
+        ConnectionState::Status,
+        ConnectionState::Login,
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+        ConnectionState::Configuration,
+#endif
+        ConnectionState::Play
+    })
     {
-        return static_cast<size_t>(ReadData<VarInt>(data, length));
+        const std::set<int> skippable = logger->GetSkippablePackets(state, source);
+        const auto handled_it = handled_packets.find({ state, source });
+
+        std::vector<bool>& table = parsing_needed[state];
+        for (const int id : skippable)
+        {
+            if (id < 0 || (handled_it != handled_packets.end() && handled_it->second.find(id) != handled_it->second.end()))
+            {
+                continue;
+            }
+            if (id >= static_cast<int>(table.size()))
+            {
+                table.resize(id + 1, true);
+            }
+            table[id] = false;
+        }
     }
-    catch (const std::exception&)
+}
+
+bool MinecraftProxy::IsParsingNeeded(const ConnectionState connection_state, const Endpoint source, const int packet_id) const
+{
+    const std::map<ConnectionState, std::vector<bool>>& parsing_needed = source == Endpoint::Server ? server_parsing_needed : client_parsing_needed;
+    const auto it = parsing_needed.find(connection_state);
+    if (it == parsing_needed.end() || packet_id < 0 || packet_id >= static_cast<int>(it->second.size()))
     {
-        return 0;
+        return true;
     }
+    return it->second[packet_id];
 }
 
-std::vector<unsigned char> MinecraftProxy::PacketToBytes(const Packet& packet) const
+size_t MinecraftProxy::StartCutThrough(const std::vector<unsigned char>::const_iterator& data, const size_t length, const size_t packet_size, const Endpoint source)
 {
-    std::vector<unsigned char> content;
-    packet.Write(content);
+    if (cut_through_threshold == 0 || packet_size < cut_through_threshold)
+    {
+        return 0;
+    }
 
+    const ConnectionState packet_connection_state = connection_state;
+
+    // Read the packet id, without throwing if we don't have enough bytes yet
+    const unsigned char* header = &(*data);
+    size_t remaining_bytes = length;
+    int value = 0;
+    size_t value_size = ReadVarIntNoThrow(header, remaining_bytes, value);
+    header += value_size;
+    remaining_bytes -= value_size;
+
+    int data_length = 0;
     if (compression_threshold > -1)
     {
-        if (content.size() < compression_threshold)
+        value_size = ReadVarIntNoThrow(header, remaining_bytes, data_length);
+        // Invalid packets are rejected by ProcessPacket once complete
+        if (value_size == 0 || !IsValidDataLength(data_length, compression_threshold))
         {
-            content.insert(content.begin(), 0x00);
+            return 0;
+        }
+        header += value_size;
+        remaining_bytes -= value_size;
+    }
 
+    int packet_id = -1;
+    if (remaining_bytes == 0)
+    {
+        return 0;
+    }
+    else if (data_length != 0)
+    {
+        // A VarInt is at most 5 bytes long
+        const std::vector<unsigned char>& head = (source == Endpoint::Server ? server_decompressor : client_decompressor)->DecompressHead(header, remaining_bytes, 5);
+        value_size = ReadVarIntNoThrow(head.data(), head.size(), packet_id);
+    }
+    else
+    {
+        value_size = ReadVarIntNoThrow(header, remaining_bytes, packet_id);
+    }
+    if (value_size == 0)
+    {
+        return 0;
+    }
+
+    // Handlers may need to replace the packet, it has to be complete
+    if (IsHandledPacket(packet_connection_state, source, packet_id))
+    {
+        return 0;
+    }
+
+    CutThroughPacket& cut_through = source == Endpoint::Server ? server_cut_through : client_cut_through;
+    cut_through.remaining_bytes = packet_size;
+    cut_through.header_size = length - remaining_bytes;
+    cut_through.connection_state = packet_connection_state;
+    cut_through.data_length = data_length;
+    cut_through.parse = IsParsingNeeded(packet_connection_state, source, packet_id);
+    if (cut_through.parse)
+    {
+        cut_through.bytes = AcquireBuffer(packet_size);
+    }
+    else
+    {
+        logger->LogSkipped(packet_connection_state, source, packet_id, packet_size);
+    }
+
+    return ContinueCutThrough(data, length, source);
+}
+
+size_t MinecraftProxy::ContinueCutThrough(const std::vector<unsigned char>::const_iterator& data, const size_t length, const Endpoint source)
+{
+    Connection& dst_connection = source == Endpoint::Server ? client_connection : server_connection;
+    CutThroughPacket& cut_through = source == Endpoint::Server ? server_cut_through : client_cut_through;
+
+    const size_t forwarded = std::min(length, cut_through.remaining_bytes);
+    // Copy before forwarding, as the forwarded bytes can be encrypted in place
+    if (cut_through.parse)
+    {
+        cut_through.bytes->insert(cut_through.bytes->end(), data, data + forwarded);
+    }
+    dst_connection.WriteData(ShareData(data, forwarded, source));
+    cut_through.remaining_bytes -= forwarded;
+
+    // The whole packet has been forwarded, parse it to log it
+    if (cut_through.remaining_bytes == 0 && cut_through.parse)
+    {
+        ParseAndLog(std::move(cut_through.bytes), cut_through.header_size, cut_through.data_length, cut_through.connection_state, source);
+    }
+
+    return forwarded;
+}
+
+void MinecraftProxy::ParseAndLog(PooledBuffer&& bytes, const size_t header_size, const int data_length, const ConnectionState packet_connection_state, const Endpoint source)
+{
+    std::vector<PendingLog>& pending_logs = source == Endpoint::Server ? server_pending_logs : client_pending_logs;
+    pending_logs.push_back({ nullptr, std::move(bytes), header_size, data_length, std::chrono::system_clock::now(), packet_connection_state, source, 0, true });
+    pending_logs.back().bandwidth_bytes = pending_logs.back().bytes.size();
+}
+
+void MinecraftProxy::LogPacket(const Endpoint lane, const std::shared_ptr<Packet>& packet, const ConnectionState connection_state, const Endpoint origin, const size_t bandwidth_bytes, const bool replay)
+{
+    std::vector<PendingLog>& pending_logs = lane == Endpoint::Server ? server_pending_logs : client_pending_logs;
+    pending_logs.push_back({ packet, {}, 0, 0, std::chrono::system_clock::now(), connection_state, origin, bandwidth_bytes, replay });
+}
+
+void MinecraftProxy::FlushPendingLogs(const Endpoint lane)
+{
+    std::vector<PendingLog>& pending_logs = lane == Endpoint::Server ? server_pending_logs : client_pending_logs;
+    if (pending_logs.empty())
+    {
+        return;
+    }
+
+    // Don't capture this, the proxy can be destroyed before the parsing strand is done
+    std::shared_ptr<Decompressor> decompressor = forward_first ? deferred_decompressor : (lane == Endpoint::Server ? server_decompressor : client_decompressor);
+    auto log = [logger = logger, replay_logger = replay_logger, decompressor, pending_logs = std::move(pending_logs)]() mutable {
+        std::vector<LogItem> items;
+        items.reserve(pending_logs.size());
+        for (PendingLog& pending : pending_logs)
+        {
+            if (pending.packet == nullptr)
+            {
+                pending.packet = ParsePacket(pending.bytes.cbegin() + pending.header_size, pending.bytes.size() - pending.header_size, pending.data_length, pending.connection_state, pending.origin, *decompressor);
+                if (pending.packet == nullptr)
+                {
+                    continue;
+                }
+            }
+            if (pending.replay && replay_logger)
+            {
+                replay_logger->Log(pending.packet, pending.connection_state, pending.origin);
+            }
+            items.push_back({ pending.packet, pending.date, pending.connection_state, pending.origin, pending.bandwidth_bytes });
         }
-        else
+        logger->Log(std::move(items));
+    };
+    pending_logs.clear();
+
+    // In forward first mode, parse and log everything later, keeping the packets order
+    if (forward_first)
+    {
+        asio::post(parsing_strand, std::move(log));
+    }
+    else
+    {
+        log();
+    }
+}
+
+template <typename PacketsTuple, size_t... Indices>
+std::set<int> MinecraftProxy::GetHandledIds(std::index_sequence<Indices...>)
+{
+    std::set<int> ids;
+    ((HasHandleOverride<std::tuple_element_t<Indices, PacketsTuple>>::value ? static_cast<void>(ids.insert(static_cast<int>(Indices))) : static_cast<void>(0)), ...);
+    return ids;
+}
+
+template <typename PacketsTuple>
+std::set<int> MinecraftProxy::GetHandledIds()
+{
+    return GetHandledIds<PacketsTuple>(std::make_index_sequence<std::tuple_size_v<PacketsTuple>>{});
+}
+
+const std::map<std::pair<ConnectionState, Endpoint>, std::set<int>>& MinecraftProxy::GetHandledPackets()
+{
+    static const std::map<std::pair<ConnectionState, Endpoint>, std::set<int>> handled_packets = {
+        { { ConnectionState::Handshake, Endpoint::Client }, GetHandledIds<AllServerboundHandshakingPackets>() },
+        { { ConnectionState::Status, Endpoint::Client }, GetHandledIds<AllServerboundStatusPackets>() },
+        { { ConnectionState::Status, Endpoint::Server }, GetHandledIds<AllClientboundStatusPackets>() },
+        { { ConnectionState::Login, Endpoint::Client }, GetHandledIds<AllServerboundLoginPackets>() },
+        { { ConnectionState::Login, Endpoint::Server }, GetHandledIds<AllClientboundLoginPackets>() },
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+        { { ConnectionState::Configuration, Endpoint::Client }, GetHandledIds<AllServerboundConfigurationPackets>() },
+        { { ConnectionState::Configuration, Endpoint::Server }, GetHandledIds<AllClientboundConfigurationPackets>() },
+#endif
+        { { ConnectionState::Play, Endpoint::Client }, GetHandledIds<AllServerboundPlayPackets>() },
+        { { ConnectionState::Play, Endpoint::Server }, GetHandledIds<AllClientboundPlayPackets>() },
+    };
+    return handled_packets;
+}
+
+bool MinecraftProxy::IsHandledPacket(const ConnectionState connection_state, const Endpoint source, const int packet_id)
+{
+    const std::map<std::pair<ConnectionState, Endpoint>, std::set<int>>& handled_packets = GetHandledPackets();
+    const auto it = handled_packets.find({ connection_state, source });
+    return it != handled_packets.end() && it->second.find(packet_id) != it->second.end();
+}
+
+bool MinecraftProxy::HasHandledPackets(const ConnectionState connection_state, const Endpoint source)
+{
+    const std::map<std::pair<ConnectionState, Endpoint>, std::set<int>>& handled_packets = GetHandledPackets();
+    const auto it = handled_packets.find({ connection_state, source });
+    return it != handled_packets.end() && !it->second.empty();
+}
+
+bool MinecraftProxy::IsValidDataLength(const int data_length, const int threshold)
+{
+    // Same rules as the vanilla decoder, packets below the threshold must be sent uncompressed
+    return data_length == 0 || (data_length >= threshold && data_length <= MAX_PACKET_DATA_LENGTH);
+}
+
+std::shared_ptr<Packet> MinecraftProxy::ParsePacket(std::vector<unsigned char>::const_iterator data, size_t length, const int data_length, const ConnectionState packet_connection_state, const Endpoint source, Decompressor& decompressor)
+{
+    if (data_length != 0)
+    {
+        try
         {
-            std::vector<unsigned char> compressed_data = Compress(content);
-            const int decompressed_size = static_cast<int>(content.size());
-            content.clear();
-            WriteData<VarInt>(decompressed_size, content);
-            content.insert(content.end(), compressed_data.begin(), compressed_data.end());
+            const std::vector<unsigned char>& uncompressed = decompressor.Decompress(&(*data), length, data_length);
+            data = uncompressed.cbegin();
+            length = uncompressed.size();
+        }
+        catch (const std::exception& ex)
+        {
+            std::cout << ((source == Endpoint::Server) ? "Server --> Client: " : "Client --> Server: ") <<
+                "DECOMPRESSION EXCEPTION " << ex.what() << std::endl;
+            return nullptr;
         }
     }
 
-    std::vector<unsigned char> sized_packet;
-    WriteData<VarInt>(static_cast<int>(content.size()), sized_packet);
-    sized_packet.insert(std::end(sized_packet), std::cbegin(content), std::cend(content));
-    return sized_packet;
+    int minecraft_id = -1;
+    std::shared_ptr<Packet> packet;
+    // Can run on the parsing strand, where nothing would catch an exception, so nothing read from the peer can throw past this point
+    try
+    {
+        minecraft_id = ReadData<VarInt>(data, length);
+
+        packet = source == Endpoint::Client ?
+            CreatePooledServerboundPacket(packet_connection_state, minecraft_id) :
+            CreatePooledClientboundPacket(packet_connection_state, minecraft_id);
+
+        if (packet == nullptr)
+        {
+            std::cout << ((source == Endpoint::Server) ? "Server --> Client: " : "Client --> Server: ") <<
+                "NULL MESSAGE WITH ID: " << minecraft_id << std::endl;
+            return nullptr;
+        }
+
+        packet->Read(data, length);
+    }
+    catch (const std::exception& ex)
+    {
+        std::cout << ((source == Endpoint::Server) ? "Server --> Client: " : "Client --> Server: ") <<
+            "PARSING EXCEPTION for message " << (packet != nullptr ? packet->GetName() : "unknown") << "(: " << minecraft_id << ")" << ex.what() << std::endl;
+        return nullptr;
+    }
+
+    return packet;
 }
 
 void MinecraftProxy::Handle(ServerboundClientIntentionPacket& packet)
@@ -234,7 +649,7 @@ void MinecraftProxy::Handle(ServerboundClientIntentionPacket& packet)
     sniffcraft_hostname = packet.GetHostName();
     sniffcraft_port = packet.GetPort();
 #endif
-    transmit_original_packet = false;
+    transmit_original_serverbound_packet = false;
 
     const ConnectionState old_connection_state = connection_state;
     switch (packet.GetIntention())
@@ -267,11 +682,11 @@ void MinecraftProxy::Handle(ServerboundClientIntentionPacket& packet)
     replacement_intention_packet->SetHostName(new_hostname);
     replacement_intention_packet->SetPort(server_port_);
 
-    std::vector<unsigned char> replacement_bytes = PacketToBytes(*replacement_intention_packet);
-    server_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*replacement_intention_packet);
+    server_connection.WriteData(std::move(replacement_bytes));
 
     // We don't log packet size as it's not really part of the network data
-    logger->Log(replacement_intention_packet, old_connection_state, Endpoint::SniffcraftToServer, 0);
+    LogPacket(Endpoint::Client, replacement_intention_packet, old_connection_state, Endpoint::SniffcraftToServer, 0);
     // Don't replay log it as it's serverbound
 }
 
@@ -283,7 +698,7 @@ void MinecraftProxy::Handle(ServerboundHelloPacket& packet)
         return;
     }
 
-    transmit_original_packet = false;
+    transmit_original_serverbound_packet = false;
 
     // Make sure we use the name and the signature key
     // of the profile we auth with
@@ -311,10 +726,10 @@ void MinecraftProxy::Handle(ServerboundHelloPacket& packet)
 #endif
 #endif
 
-    std::vector<unsigned char> replacement_bytes = PacketToBytes(*replacement_hello_packet);
-    server_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*replacement_hello_packet);
+    server_connection.WriteData(std::move(replacement_bytes));
     // We don't log packet size as it's not really part of the network data
-    logger->Log(replacement_hello_packet, connection_state, Endpoint::SniffcraftToServer, 0);
+    LogPacket(Endpoint::Client, replacement_hello_packet, connection_state, Endpoint::SniffcraftToServer, 0);
     // Don't replay log it as it's serverbound
 #endif
 }
@@ -348,7 +763,7 @@ void MinecraftProxy::Handle(ClientboundHelloPacket& packet)
         throw std::runtime_error("Not authenticated");
     }
 
-    transmit_original_packet = false;
+    transmit_original_clientbound_packet = false;
 
     std::unique_ptr<Botcraft::AESEncrypter> encrypter = std::make_unique<Botcraft::AESEncrypter>();
 
@@ -396,19 +811,20 @@ void MinecraftProxy::Handle(ClientboundHelloPacket& packet)
 #endif
 
     // Send additional packet only to server on behalf of the client
-    const std::vector<unsigned char> replacement_bytes = PacketToBytes(*response_packet);
-    server_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*response_packet);
+    server_connection.WriteData(std::move(replacement_bytes));
 
     // We don't log packet size as it's not really part of the network data
-    logger->Log(response_packet, connection_state, Endpoint::SniffcraftToServer, 0);
+    LogPacket(Endpoint::Server, response_packet, connection_state, Endpoint::SniffcraftToServer, 0);
 
     // Set the encrypter for any future message from the server
-    std::unique_ptr<DataProcessor> encryption_data_processor = std::make_unique<MinecraftEncryptionDataProcessor>(encrypter);
+    std::unique_ptr<DataProcessor> encryption_data_processor = std::make_unique<MinecraftEncryptionDataProcessor>(raw_shared_secret);
     server_connection.SetDataProcessor(encryption_data_processor);
 
     // Dirty trick to increase the chances the key packet is not sent packed with the next packet in the TCP connection
-    // This prevents the server to load the next packet bytes before this packet is processed and decryption is enabled
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // This prevents the server to load the next packet bytes before this packet is processed and decryption is enabled.
+    // Pause this lane with a timer instead of sleeping, so the shared network thread keeps running the other proxies
+    PauseLane(Endpoint::Server, std::chrono::milliseconds(100));
 
 #else
     std::cerr << "WARNING, trying to connect to a server with encryption enabled\n" <<
@@ -434,6 +850,7 @@ void MinecraftProxy::Handle(ClientboundLoginPacket& packet)
     key.SetSignature(Botcraft::Utilities::DecodeBase64(authentifier->GetKeySignature()));
 
     chat_session_data.SetProfilePublicKey(key);
+    std::lock_guard<std::mutex> chat_lock(chat_mutex);
     chat_session_uuid = UUID();
     std::mt19937 rnd = std::mt19937(static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count()));
     std::uniform_int_distribution<int> distrib(std::numeric_limits<unsigned char>::min(), std::numeric_limits<unsigned char>::max());
@@ -444,12 +861,12 @@ void MinecraftProxy::Handle(ClientboundLoginPacket& packet)
     chat_session_data.SetUuid(chat_session_uuid);
 
     chat_session_packet->SetChatSession(chat_session_data);
-    std::vector<unsigned char> chat_session_packet_bytes = PacketToBytes(*chat_session_packet);
+    PooledBuffer chat_session_packet_bytes = PacketToBytes(*chat_session_packet);
 
-    server_connection.WriteData(chat_session_packet_bytes.data(), chat_session_packet_bytes.size());
+    server_connection.WriteData(std::move(chat_session_packet_bytes));
 
     // We don't log packet size as it's not really part of the network data
-    logger->Log(chat_session_packet, connection_state, Endpoint::SniffcraftToServer, 0);
+    LogPacket(Endpoint::Server, chat_session_packet, connection_state, Endpoint::SniffcraftToServer, 0);
 }
 
 void MinecraftProxy::Handle(ServerboundChatPacket& packet)
@@ -459,7 +876,7 @@ void MinecraftProxy::Handle(ServerboundChatPacket& packet)
         return;
     }
 
-    transmit_original_packet = false;
+    transmit_original_serverbound_packet = false;
 
     // Ugly stuff because there is a GetMessage macro in Windows API somewhere :)
 #if _MSC_VER || __MINGW32__
@@ -473,6 +890,7 @@ void MinecraftProxy::Handle(ServerboundChatPacket& packet)
     long long int salt, timestamp;
     std::vector<unsigned char> signature;
 
+    std::lock_guard<std::mutex> chat_lock(chat_mutex);
     const auto [signatures, updates] = chat_context.GetLastSeenMessagesUpdate();
     const int current_message_sent_index = message_sent_index++;
     signature = authentifier->GetMessageSignature(packet.GetMessage(), current_message_sent_index, chat_session_uuid, signatures, salt, timestamp);
@@ -490,10 +908,10 @@ void MinecraftProxy::Handle(ServerboundChatPacket& packet)
     replacement_chat_packet->SetSalt(salt);
     replacement_chat_packet->SetSignature(signature);
 
-    const std::vector<unsigned char> replacement_bytes = PacketToBytes(*replacement_chat_packet);
-    server_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*replacement_chat_packet);
+    server_connection.WriteData(std::move(replacement_bytes));
     // We don't log packet size as it's not really part of the network data
-    logger->Log(replacement_chat_packet, connection_state, Endpoint::SniffcraftToServer, 0);
+    LogPacket(Endpoint::Client, replacement_chat_packet, connection_state, Endpoint::SniffcraftToServer, 0);
 }
 
 #if PROTOCOL_VERSION < 766 /* < 1.20.5 */
@@ -507,7 +925,7 @@ void MinecraftProxy::Handle(ServerboundChatCommandSignedPacket& packet)
         return;
     }
 
-    transmit_original_packet = false;
+    transmit_original_serverbound_packet = false;
 
 #if PROTOCOL_VERSION < 766 /* < 1.20.5 */
     std::shared_ptr<ServerboundChatCommandPacket> replacement_chat_command = std::make_shared<ServerboundChatCommandPacket>();
@@ -517,14 +935,15 @@ void MinecraftProxy::Handle(ServerboundChatCommandSignedPacket& packet)
     replacement_chat_command->SetCommand(packet.GetCommand());
     replacement_chat_command->SetTimestamp(packet.GetTimestamp());
     replacement_chat_command->SetSalt(packet.GetSalt());
+    std::lock_guard<std::mutex> chat_lock(chat_mutex);
     const auto [signatures, updates] = chat_context.GetLastSeenMessagesUpdate();
     replacement_chat_command->SetLastSeenMessages(updates);
     replacement_chat_command->SetArgumentSignatures(packet.GetArgumentSignatures());
 
-    const std::vector<unsigned char> replacement_bytes = PacketToBytes(*replacement_chat_command);
-    server_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*replacement_chat_command);
+    server_connection.WriteData(std::move(replacement_bytes));
     // We don't log packet size as it's not really part of the network data
-    logger->Log(replacement_chat_command, connection_state, Endpoint::SniffcraftToServer, 0);
+    LogPacket(Endpoint::Client, replacement_chat_command, connection_state, Endpoint::SniffcraftToServer, 0);
 }
 
 void MinecraftProxy::Handle(ClientboundPlayerChatPacket& packet)
@@ -536,6 +955,7 @@ void MinecraftProxy::Handle(ClientboundPlayerChatPacket& packet)
 
     if (packet.GetSignature().has_value())
     {
+        std::lock_guard<std::mutex> chat_lock(chat_mutex);
         chat_context.AddSeenMessage(std::vector<unsigned char>(packet.GetSignature().value().begin(), packet.GetSignature().value().end()));
 
         if (chat_context.GetOffset() > 64)
@@ -543,10 +963,10 @@ void MinecraftProxy::Handle(ClientboundPlayerChatPacket& packet)
             std::shared_ptr<ServerboundChatAckPacket> ack_packet = std::make_shared<ServerboundChatAckPacket>();
             ack_packet->SetOffset(chat_context.GetAndResetOffset());
 
-            const std::vector<unsigned char> replacement_bytes_ack = PacketToBytes(*ack_packet);
-            server_connection.WriteData(replacement_bytes_ack.data(), replacement_bytes_ack.size());
+            PooledBuffer replacement_bytes_ack = PacketToBytes(*ack_packet);
+            server_connection.WriteData(std::move(replacement_bytes_ack));
             // We don't log packet size as it's not really part of the network data
-            logger->Log(ack_packet, connection_state, Endpoint::SniffcraftToServer, 0);
+            LogPacket(Endpoint::Server, ack_packet, connection_state, Endpoint::SniffcraftToServer, 0);
         }
     }
 }
@@ -573,26 +993,26 @@ void MinecraftProxy::Handle(ServerboundConfigurationAcknowledgedPacket& packet)
 void MinecraftProxy::Handle(ClientboundTransferConfigurationPacket& packet)
 {
     transfer_callback(packet.GetHost(), packet.GetPort());
-    transmit_original_packet = false;
+    transmit_original_clientbound_packet = false;
     std::shared_ptr<ClientboundTransferConfigurationPacket> replacement_transfer_packet = std::make_shared<ClientboundTransferConfigurationPacket>();
     replacement_transfer_packet->SetHost(sniffcraft_hostname);
     replacement_transfer_packet->SetPort(sniffcraft_port);
-    const std::vector<unsigned char> replacement_bytes = PacketToBytes(*replacement_transfer_packet);
-    client_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*replacement_transfer_packet);
+    client_connection.WriteData(std::move(replacement_bytes));
     // We don't log packet size as it's not really part of the network data
-    logger->Log(replacement_transfer_packet, connection_state, Endpoint::SniffcraftToClient, 0);
+    LogPacket(Endpoint::Server, replacement_transfer_packet, connection_state, Endpoint::SniffcraftToClient, 0);
 }
 
 void MinecraftProxy::Handle(ClientboundTransferPacket& packet)
 {
     transfer_callback(packet.GetHost(), packet.GetPort());
-    transmit_original_packet = false;
+    transmit_original_clientbound_packet = false;
     std::shared_ptr<ClientboundTransferPacket> replacement_transfer_packet = std::make_shared<ClientboundTransferPacket>();
     replacement_transfer_packet->SetHost(sniffcraft_hostname);
     replacement_transfer_packet->SetPort(sniffcraft_port);
-    const std::vector<unsigned char> replacement_bytes = PacketToBytes(*replacement_transfer_packet);
-    client_connection.WriteData(replacement_bytes.data(), replacement_bytes.size());
+    PooledBuffer replacement_bytes = PacketToBytes(*replacement_transfer_packet);
+    client_connection.WriteData(std::move(replacement_bytes));
     // We don't log packet size as it's not really part of the network data
-    logger->Log(replacement_transfer_packet, connection_state, Endpoint::SniffcraftToClient, 0);
+    LogPacket(Endpoint::Server, replacement_transfer_packet, connection_state, Endpoint::SniffcraftToClient, 0);
 }
 #endif
@@ -0,0 +1,91 @@
+#include "sniffcraft/PacketPool.hpp"
+#include "sniffcraft/PoolAllocator.hpp"
+
+#include <protocolCraft/AllPackets.hpp>
+
+#include <array>
+#include <atomic>
+#include <tuple>
+#include <utility>
+
+using namespace ProtocolCraft;
+
+namespace
+{
+    struct PacketPoolCounters
+    {
+        static inline std::atomic<size_t> heap_allocations = 0;
+        static inline std::atomic<size_t> reused_allocations = 0;
+    };
+
+    template <typename T>
+    std::shared_ptr<Packet> CreatePooledPacket()
+    {
+        return std::allocate_shared<T>(PoolAllocator<T, PacketPoolCounters>());
+    }
+
+    template <typename Tuple, size_t... Indices>
+    std::shared_ptr<Packet> CreatePooledPacket(const int id, std::index_sequence<Indices...>)
+    {
+        static constexpr std::array<std::shared_ptr<Packet>(*)(), sizeof...(Indices)> creators = { &CreatePooledPacket<std::tuple_element_t<Indices, Tuple>>... };
+        if (id < 0 || id >= static_cast<int>(creators.size()))
+        {
+            return nullptr;
+        }
+        return creators[id]();
+    }
+
+    template <typename Tuple>
+    std::shared_ptr<Packet> CreatePooledPacket(const int id)
+    {
+        return CreatePooledPacket<Tuple>(id, std::make_index_sequence<std::tuple_size_v<Tuple>>{});
+    }
+}
+
+std::shared_ptr<Packet> CreatePooledClientboundPacket(const ConnectionState connection_state, const int id)
+{
+    switch (connection_state)
+    {
+    case ConnectionState::Status:
+        return CreatePooledPacket<AllClientboundStatusPackets>(id);
+    case ConnectionState::Login:
+        return CreatePooledPacket<AllClientboundLoginPackets>(id);
+    case ConnectionState::Play:
+        return CreatePooledPacket<AllClientboundPlayPackets>(id);
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+    case ConnectionState::Configuration:
+        return CreatePooledPacket<AllClientboundConfigurationPackets>(id);
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+std::shared_ptr<Packet> CreatePooledServerboundPacket(const ConnectionState connection_state, const int id)
+{
+    switch (connection_state)
+    {
+    case ConnectionState::Handshake:
+        return CreatePooledPacket<AllServerboundHandshakingPackets>(id);
+    case ConnectionState::Status:
+        return CreatePooledPacket<AllServerboundStatusPackets>(id);
+    case ConnectionState::Login:
+        return CreatePooledPacket<AllServerboundLoginPackets>(id);
+    case ConnectionState::Play:
+        return CreatePooledPacket<AllServerboundPlayPackets>(id);
+#if PROTOCOL_VERSION > 763 /* > 1.20.1 */
+    case ConnectionState::Configuration:
+        return CreatePooledPacket<AllServerboundConfigurationPackets>(id);
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+PacketPoolStats GetPacketPoolStats()
+{
+    PacketPoolStats stats;
+    stats.heap_allocations = PacketPoolCounters::heap_allocations.load(std::memory_order_relaxed);
+    stats.reused_allocations = PacketPoolCounters::reused_allocations.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -9,44 +9,34 @@ using namespace ProtocolCraft;
 
 ReplayModLogger::ReplayModLogger()
 {
-    is_running = true;
-    log_thread = std::thread(&ReplayModLogger::LogConsume, this);
+    OpenSession();
 }
 
 ReplayModLogger::~ReplayModLogger()
 {
-    if (is_running)
-    {
-        is_running = false;
-        log_condition.notify_all();
-
-        while (!logging_queue.empty())
-        {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        }
-
-        if (log_thread.joinable())
-        {
-            log_thread.join();
-        }
-        replay_file.close();
-
-        SaveReplayMetadataFile();
-        WrapMCPRFile();
-    }
+    // Log worker writes everything already sent and closes the file before releasing the session
+    ReleaseSession();
+
+    SaveReplayMetadataFile();
+    WrapMCPRFile();
 }
 
 void ReplayModLogger::Log(const std::shared_ptr<Packet> packet, const ConnectionState connection_state, const Endpoint origin)
 {
-    if (!is_running)
-    {
-        return;
-    }
+    PushRecord({ packet, std::chrono::system_clock::now(), connection_state, origin });
+}
+
+void ReplayModLogger::SetServerName(const std::string& server_name_)
+{
+    server_name = server_name_;
+}
 
-    std::lock_guard<std::mutex> log_guard(log_mutex);
+void ReplayModLogger::Consume(LogItem& item)
+{
+    // Replay starts with the first logged packet
     if (!replay_file.is_open())
     {
-        start_time = std::chrono::system_clock::now();
+        start_time = item.date;
         auto in_time_t = std::chrono::system_clock::to_time_t(start_time);
 
         std::stringstream ss;
@@ -55,49 +45,26 @@ void ReplayModLogger::Log(const std::shared_ptr<Packet> packet, const Connection
         replay_file = std::ofstream(session_prefix + "_recording.tmcpr", std::ios::out | std::ios::binary);
     }
 
-    logging_queue.push({ packet, std::chrono::system_clock::now(), connection_state, origin });
-    log_condition.notify_all();
-}
-
-void ReplayModLogger::SetServerName(const std::string& server_name_)
-{
-    server_name = server_name_;
+    if (item.origin == Endpoint::Server || item.origin == Endpoint::SniffcraftToClient)
+    {
+        std::vector<unsigned char> packet;
+        // Write ID + Packet data
+        item.packet->Write(packet);
+
+        // Get timestamp in ms
+        std::vector<unsigned char> header;
+        WriteData<int>(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(item.date - start_time).count()), header);
+        // Get total size
+        WriteData<int>(static_cast<int>(packet.size()), header);
+
+        replay_file.write(reinterpret_cast<const char*>(header.data()), header.size());
+        replay_file.write(reinterpret_cast<const char*>(packet.data()), packet.size());
+    }
 }
 
-void ReplayModLogger::LogConsume()
+void ReplayModLogger::OnClose()
 {
-    while (is_running)
-    {
-        {
-            std::unique_lock<std::mutex> lock(log_mutex);
-            log_condition.wait(lock);
-        }
-        while (!logging_queue.empty())
-        {
-            LogItem item;
-            {
-                std::lock_guard<std::mutex> log_guard(log_mutex);
-                item = logging_queue.front();
-                logging_queue.pop();
-            }
-
-            if (item.origin == Endpoint::Server || item.origin == Endpoint::SniffcraftToClient)
-            {
-                std::vector<unsigned char> packet;
-                // Write ID + Packet data
-                item.packet->Write(packet);
-
-                // Get timestamp in ms
-                std::vector<unsigned char> header;
-                WriteData<int>(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(item.date - start_time).count()), header);
-                // Get total size
-                WriteData<int>(static_cast<int>(packet.size()), header);
-
-                replay_file.write(reinterpret_cast<const char*>(header.data()), header.size());
-                replay_file.write(reinterpret_cast<const char*>(packet.data()), packet.size());
-            }
-        }
-    }
+    replay_file.close();
 }
 
 void ReplayModLogger::SaveReplayMetadataFile() const
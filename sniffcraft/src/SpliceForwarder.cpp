@@ -0,0 +1,202 @@
+#include "sniffcraft/SpliceForwarder.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/// @brief Maximum number of chunks moved in one Transfer call, to let other handlers run
+constexpr int MAX_CHUNKS_PER_TRANSFER = 16;
+
+SpliceForwarder::SpliceForwarder(Connection& src, Connection& dst, const std::weak_ptr<void>& owner, const std::function<void()>& on_stop) :
+    src(src),
+    dst(dst),
+    owner(owner),
+    on_stop(on_stop)
+{
+    pipe_fds[0] = -1;
+    pipe_fds[1] = -1;
+    bytes_in_pipe = 0;
+    transferred_bytes = 0;
+    source_closed = false;
+    stopped = true;
+    failed = false;
+}
+
+SpliceForwarder::~SpliceForwarder()
+{
+#ifdef __linux__
+    for (int i = 0; i < 2; ++i)
+    {
+        if (pipe_fds[i] != -1)
+        {
+            close(pipe_fds[i]);
+        }
+    }
+#endif
+}
+
+bool SpliceForwarder::IsSupported()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::optional<std::string> SpliceForwarder::Prepare()
+{
+#ifdef __linux__
+    if (pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        return std::string("Error creating splice pipe: ") + std::strerror(errno);
+    }
+    // Try to have room for a full chunk in the pipe, keep the default size if not allowed
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, static_cast<int>(SPLICE_CHUNK_SIZE));
+
+    asio::error_code ec;
+    src.GetSocket().native_non_blocking(true, ec);
+    if (!ec)
+    {
+        dst.GetSocket().native_non_blocking(true, ec);
+    }
+    if (ec)
+    {
+        return "Error setting sockets in non blocking mode: " + ec.message();
+    }
+
+    return std::nullopt;
+#else
+    return std::string("splice forwarding is only supported on Linux");
+#endif
+}
+
+void SpliceForwarder::Start()
+{
+    stopped = false;
+    // Nothing else reads the source, idle detection relies on the activity stamped here
+    src.StampActivity();
+    asio::post(src.GetSocket().get_executor(), [this, keep_alive = owner.lock()]() { Transfer(); });
+}
+
+size_t SpliceForwarder::GetTransferredBytes() const
+{
+    return transferred_bytes;
+}
+
+bool SpliceForwarder::Stopped() const
+{
+    return stopped;
+}
+
+bool SpliceForwarder::Failed() const
+{
+    return failed;
+}
+
+void SpliceForwarder::Transfer()
+{
+#ifdef __linux__
+    if (stopped)
+    {
+        return;
+    }
+
+    asio::ip::tcp::socket& src_socket = src.GetSocket();
+    asio::ip::tcp::socket& dst_socket = dst.GetSocket();
+    for (int i = 0; i < MAX_CHUNKS_PER_TRANSFER; ++i)
+    {
+        // Fill the pipe from the source socket
+        if (bytes_in_pipe == 0 && !source_closed)
+        {
+            const ssize_t n = splice(src_socket.native_handle(), nullptr, pipe_fds[1], nullptr, SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == 0)
+            {
+                source_closed = true;
+            }
+            else if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    src_socket.async_wait(asio::ip::tcp::socket::wait_read,
+                        [this, keep_alive = owner.lock()](const asio::error_code& ec) { handle_ready(ec); });
+                    return;
+                }
+                Stop(true);
+                return;
+            }
+            else
+            {
+                bytes_in_pipe = static_cast<size_t>(n);
+                src.StampActivity();
+            }
+        }
+
+        // Empty the pipe into the destination socket
+        while (bytes_in_pipe > 0)
+        {
+            const ssize_t n = splice(pipe_fds[0], nullptr, dst_socket.native_handle(), nullptr, bytes_in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    dst_socket.async_wait(asio::ip::tcp::socket::wait_write,
+                        [this, keep_alive = owner.lock()](const asio::error_code& ec) { handle_ready(ec); });
+                    return;
+                }
+                Stop(true);
+                return;
+            }
+            bytes_in_pipe -= static_cast<size_t>(n);
+            transferred_bytes += static_cast<size_t>(n);
+        }
+
+        // Source closed and everything it sent has been forwarded,
+        // only close this direction, the other one can still be used
+        if (source_closed)
+        {
+            asio::error_code ec;
+            dst_socket.shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+            src.StopIdleCheck();
+            Stop(static_cast<bool>(ec));
+            return;
+        }
+    }
+
+    // Still some data, but give other handlers a chance to run
+    asio::post(src_socket.get_executor(), [this, keep_alive = owner.lock()]() { Transfer(); });
+#endif
+}
+
+void SpliceForwarder::handle_ready(const asio::error_code& ec)
+{
+    if (stopped || ec == asio::error::operation_aborted)
+    {
+        return;
+    }
+
+    if (ec)
+    {
+        Stop(true);
+        return;
+    }
+
+    Transfer();
+}
+
+void SpliceForwarder::Stop(const bool error)
+{
+    if (stopped)
+    {
+        return;
+    }
+    stopped = true;
+    failed = error;
+    if (on_stop)
+    {
+        on_stop();
+    }
+}
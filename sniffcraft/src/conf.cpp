@@ -22,6 +22,17 @@ const std::string Conf::raw_bytes_log_key = "LogRawBytes";
 const std::string Conf::online_key = "Online";
 const std::string Conf::network_recap_to_console_key = "NetworkRecapToConsole";
 const std::string Conf::account_cache_key_key = "MicrosoftAccountCacheKey";
+const std::string Conf::max_read_buffer_size_key = "MaxReadBufferSize";
+const std::string Conf::network_threads_key = "NetworkThreads";
+const std::string Conf::raw_forwarding_key = "RawForwarding";
+const std::string Conf::write_high_watermark_key = "WriteQueueHighWatermark";
+const std::string Conf::write_low_watermark_key = "WriteQueueLowWatermark";
+const std::string Conf::idle_timeout_key = "IdleTimeout";
+const std::string Conf::cut_through_threshold_key = "CutThroughThreshold";
+const std::string Conf::forward_first_key = "ForwardFirst";
+const std::string Conf::wire_compression_level_key = "WireCompressionLevel";
+const std::string Conf::capture_compression_level_key = "CaptureCompressionLevel";
+const std::string Conf::logging_threads_key = "LoggingThreads";
 const std::string Conf::handshaking_key = "Handshaking";
 const std::string Conf::status_key = "Status";
 const std::string Conf::login_key = "Login";
@@ -71,6 +82,28 @@ ProtocolCraft::Json::Value Conf::LoadConf()
         json[account_cache_key_key] = "";
     if (!json.contains(network_recap_to_console_key))
         json[network_recap_to_console_key] = false;
+    if (!json.contains(max_read_buffer_size_key))
+        json[max_read_buffer_size_key] = 131072;
+    if (!json.contains(network_threads_key))
+        json[network_threads_key] = 0;
+    if (!json.contains(raw_forwarding_key))
+        json[raw_forwarding_key] = false;
+    if (!json.contains(write_high_watermark_key))
+        json[write_high_watermark_key] = 4194304;
+    if (!json.contains(write_low_watermark_key))
+        json[write_low_watermark_key] = 1048576;
+    if (!json.contains(idle_timeout_key))
+        json[idle_timeout_key] = 15;
+    if (!json.contains(cut_through_threshold_key))
+        json[cut_through_threshold_key] = 65536;
+    if (!json.contains(forward_first_key))
+        json[forward_first_key] = false;
+    if (!json.contains(wire_compression_level_key))
+        json[wire_compression_level_key] = 1;
+    if (!json.contains(capture_compression_level_key))
+        json[capture_compression_level_key] = 9;
+    if (!json.contains(logging_threads_key))
+        json[logging_threads_key] = 0;
     ProtocolCraft::Json::Value packet_lists = {
         { ignored_clientbound_key, ProtocolCraft::Json::Array() },
         { ignored_serverbound_key, ProtocolCraft::Json::Array() },
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string_view>
+#include "sniffcraft/BufferPool.hpp"
 #include "sniffcraft/conf.hpp"
 #include "sniffcraft/server.hpp"
 
@@ -29,6 +30,11 @@ int main(int argc, char* argv[])
    {
        Server server = Server();
        server.run();
+
+       const BufferPoolStats buffer_pool_stats = GetBufferPoolStats();
+       std::cout << "Buffer pool: " << buffer_pool_stats.hits << " hits, "
+           << buffer_pool_stats.misses << " misses, "
+           << buffer_pool_stats.dropped << " dropped" << std::endl;
    }
    catch(std::exception& e)
    {
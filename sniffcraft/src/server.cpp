@@ -8,6 +8,7 @@
 #include <botcraft/Network/DNS/DNSSrvData.hpp>
 #include <botcraft/Utilities/StringUtilities.hpp>
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <functional>
@@ -31,6 +32,13 @@ Server::Server()
     const ProtocolCraft::Json::Value conf = Conf::LoadConf();
     client_port = conf[Conf::local_port_key].get_number<unsigned short>();
     server_address = conf[Conf::server_address_key].get_string();
+    raw_forwarding = conf[Conf::raw_forwarding_key].get<bool>();
+    idle_timeout = std::chrono::seconds(conf[Conf::idle_timeout_key].get_number<int>());
+    network_threads_count = conf[Conf::network_threads_key].get_number<unsigned int>();
+    if (network_threads_count == 0)
+    {
+        network_threads_count = std::max(1u, std::thread::hardware_concurrency());
+    }
     ResolveIpPortFromAddress();
 
     proxies_cleaning_thread = std::thread(&Server::CleanProxies, this);
@@ -75,51 +83,57 @@ void Server::run_iocontext()
     acceptor = std::make_unique<asio::ip::tcp::acceptor>(io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), client_port));
     listen_connection();
     std::cout << "Starting redirection of any connection on 127.0.0.1:" << client_port << " to " << server_ip << ":" << server_port << std::endl;
+#if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+    std::cout << "Using io_uring network backend with " << network_threads_count << " thread(s)" << std::endl;
+#endif
+
+    // All proxies share the same io_context, each one of them
+    // has its own strand so they can run in parallel on these threads
+    iocontext_threads.reserve(network_threads_count - 1);
+    for (unsigned int i = 1; i < network_threads_count; ++i)
+    {
+        iocontext_threads.emplace_back([this]() { io_context.run(); });
+    }
     io_context.run();
+
+    for (std::thread& t : iocontext_threads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    iocontext_threads.clear();
 }
 
 void Server::listen_connection()
 {
-    BaseProxy* proxy = GetNewMinecraftProxy();
+    std::shared_ptr<BaseProxy> proxy = GetNewProxy();
 
     acceptor->async_accept(proxy->ClientSocket(),
         std::bind(&Server::handle_accept, this, proxy,
             std::placeholders::_1));
 }
 
-void Server::handle_accept(BaseProxy* new_proxy, const asio::error_code& ec)
+void Server::handle_accept(const std::shared_ptr<BaseProxy>& new_proxy, const asio::error_code& ec)
 {
     if (!ec)
     {
-        std::optional<std::string> proxy_start_return;
-        if (is_next_connection_transfer)
-        {
-            is_next_connection_transfer = false;
-            proxy_start_return = new_proxy->Start(transfer_ip, transfer_port);
-            transfer_ip = "";
-            transfer_port = 0;
-        }
-        else
-        {
-            proxy_start_return = new_proxy->Start(server_ip, server_port);
-        }
-        if (proxy_start_return.has_value())
+        std::string ip = server_ip;
+        unsigned short port = server_port;
         {
-            std::cerr << "Failed to start new proxy: " << proxy_start_return.value() << std::endl;
-        }
-#ifdef WITH_GUI
-        {
-            std::scoped_lock<std::mutex> lock(loggers_mutex);
-            connection_error = proxy_start_return;
-            if (!connection_error.has_value())
+            std::scoped_lock<std::mutex> lock(transfer_mutex);
+            if (is_next_connection_transfer)
             {
-                if (MinecraftProxy* casted_proxy = dynamic_cast<MinecraftProxy*>(new_proxy))
-                {
-                    loggers.push_back(casted_proxy->GetLogger());
-                }
+                is_next_connection_transfer = false;
+                ip = transfer_ip;
+                port = transfer_port;
+                transfer_ip = "";
+                transfer_port = 0;
             }
         }
-#endif
+        // Start is asynchronous, so we can accept the next connection right away
+        new_proxy->Start(ip, port, std::bind(&Server::handle_proxy_started, this, new_proxy.get(), std::placeholders::_1));
     }
     else
     {
@@ -128,6 +142,27 @@ void Server::handle_accept(BaseProxy* new_proxy, const asio::error_code& ec)
     listen_connection();
 }
 
+void Server::handle_proxy_started(BaseProxy* proxy, const std::optional<std::string>& error)
+{
+    if (error.has_value())
+    {
+        std::cerr << "Failed to start new proxy: " << error.value() << std::endl;
+    }
+#ifdef WITH_GUI
+    {
+        std::scoped_lock<std::mutex> lock(loggers_mutex);
+        connection_error = error;
+        if (!connection_error.has_value())
+        {
+            if (MinecraftProxy* casted_proxy = dynamic_cast<MinecraftProxy*>(proxy))
+            {
+                loggers.push_back(casted_proxy->GetLogger());
+            }
+        }
+    }
+#endif
+}
+
 void Server::ResolveIpPortFromAddress()
 {
     std::string addressOnly;
@@ -229,22 +264,25 @@ void Server::ResolveIpPortFromAddress()
 
 void Server::PrepareForTransfer(const std::string& new_ip, const int new_port)
 {
+    std::scoped_lock<std::mutex> lock(transfer_mutex);
     is_next_connection_transfer = true;
     transfer_ip = new_ip;
     transfer_port = new_port;
 }
 
-BaseProxy* Server::GetNewMinecraftProxy()
+std::shared_ptr<BaseProxy> Server::GetNewProxy()
 {
     std::lock_guard<std::mutex> lock(proxies_mutex);
     // Create a new proxy
-    std::unique_ptr<BaseProxy> proxy = std::make_unique<MinecraftProxy>(
-        io_context,
-        std::bind(&Server::PrepareForTransfer, this, std::placeholders::_1, std::placeholders::_2)
-    );
-    proxies.push_back(std::move(proxy));
-
-    return proxies.back().get();
+    std::shared_ptr<BaseProxy> proxy = raw_forwarding ?
+        std::make_shared<BaseProxy>(io_context, true) :
+        std::make_shared<MinecraftProxy>(
+            io_context,
+            std::bind(&Server::PrepareForTransfer, this, std::placeholders::_1, std::placeholders::_2)
+        );
+    proxies.push_back(proxy);
+
+    return proxy;
 }
 
 void Server::CleanProxies()
@@ -254,6 +292,7 @@ void Server::CleanProxies()
     {
         {
             std::lock_guard<std::mutex> lock(proxies_mutex);
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
             // Clean old proxies
             for (int i = static_cast<int>(proxies.size()) - 1; i > -1; --i)
             {
@@ -261,6 +300,11 @@ void Server::CleanProxies()
                 {
                     proxies.erase(proxies.begin() + i);
                 }
+                // One periodic check for all proxies instead of rearming a timer on each read
+                else
+                {
+                    proxies[i]->CloseIfIdle(now, idle_timeout);
+                }
             }
         }
         std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <iostream>
+
+/// @brief Number of failed checks in the current test executable
+inline int failed_checks = 0;
+
+/// @brief Print and count a failure if condition is false, without stopping the test
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            failed_checks += 1; \
+        } \
+    } while (false)
+
+/// @brief Value main should return, non zero if any check failed
+inline int TestResult()
+{
+    if (failed_checks > 0)
+    {
+        std::cerr << failed_checks << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
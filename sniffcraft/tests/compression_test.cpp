@@ -0,0 +1,66 @@
+#include "sniffcraft/Compression.hpp"
+#include "TestUtils.hpp"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+/// @brief Check that decompressing the data throws instead of returning anything
+bool Throws(Decompressor& decompressor, const std::vector<unsigned char>& compressed, const size_t compressed_size, const size_t decompressed_size)
+{
+    try
+    {
+        decompressor.Decompress(compressed.data(), compressed_size, decompressed_size);
+    }
+    catch (const std::runtime_error&)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    std::mt19937 rng(42);
+    Compressor compressor(6);
+    Decompressor decompressor;
+
+    for (const size_t size : { 1, 255, 256, 4096, 100000, 2 * 1024 * 1024 })
+    {
+        std::vector<unsigned char> data(size);
+        for (unsigned char& c : data)
+        {
+            // Compressible but not trivial
+            c = static_cast<unsigned char>(rng() % 16);
+        }
+        const std::vector<unsigned char> compressed = compressor.Compress(data.data(), data.size());
+
+        CHECK(decompressor.Decompress(compressed.data(), compressed.size(), size) == data);
+        CHECK(Decompress(compressed.data(), compressed.size()) == data);
+
+        const std::vector<unsigned char>& head = decompressor.DecompressHead(compressed.data(), compressed.size(), 10);
+        CHECK(head.size() == std::min(size, size_t{ 10 }));
+        CHECK(std::equal(head.begin(), head.end(), data.begin()));
+
+        // A data length not matching the compressed data must be rejected,
+        // and the decompressor must still work for the next packets
+        CHECK(Throws(decompressor, compressed, compressed.size(), size + 1));
+        if (size > 1)
+        {
+            CHECK(Throws(decompressor, compressed, compressed.size(), size - 1));
+        }
+        CHECK(Throws(decompressor, compressed, compressed.size() / 2, size));
+        CHECK(decompressor.Decompress(compressed.data(), compressed.size(), size) == data);
+    }
+
+    // Data that is not zlib at all
+    std::vector<unsigned char> garbage(1000);
+    for (unsigned char& c : garbage)
+    {
+        c = static_cast<unsigned char>(rng());
+    }
+    CHECK(Throws(decompressor, garbage, garbage.size(), 4000));
+
+    return TestResult();
+}
@@ -0,0 +1,78 @@
+#include "sniffcraft/MinecraftEncryptionDataProcessor.hpp"
+#include "TestUtils.hpp"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/// @brief Reference AES-128-CFB8 done by OpenSSL, one byte of shift register at a time
+std::vector<unsigned char> ReferenceCFB8(const std::vector<unsigned char>& key, const std::vector<unsigned char>& input, const bool encrypt)
+{
+    std::vector<unsigned char> output(input.size());
+    int output_length = 0;
+    EVP_CIPHER_CTX* context = EVP_CIPHER_CTX_new();
+    EVP_CipherInit_ex(context, EVP_aes_128_cfb8(), nullptr, key.data(), key.data(), encrypt ? 1 : 0);
+    EVP_CipherUpdate(context, output.data(), &output_length, input.data(), static_cast<int>(input.size()));
+    EVP_CIPHER_CTX_free(context);
+    return output;
+}
+
+/// @brief Decrypt data with the batched processor, splitting it in chunks of the given sizes
+std::vector<unsigned char> DecryptInChunks(const std::vector<unsigned char>& key, std::vector<unsigned char> data, const std::vector<size_t>& chunk_sizes)
+{
+    MinecraftEncryptionDataProcessor processor(key);
+    size_t position = 0;
+    size_t chunk_index = 0;
+    while (position < data.size())
+    {
+        const size_t length = std::min(chunk_sizes[chunk_index++ % chunk_sizes.size()], data.size() - position);
+        processor.ProcessIncomingData(data.data() + position, length);
+        position += length;
+    }
+    return data;
+}
+
+int main()
+{
+    std::mt19937 rng(42);
+    std::vector<unsigned char> key(16);
+    for (unsigned char& k : key)
+    {
+        k = static_cast<unsigned char>(rng());
+    }
+    std::vector<unsigned char> plaintext(64 * 1024 + 7);
+    for (unsigned char& c : plaintext)
+    {
+        c = static_cast<unsigned char>(rng());
+    }
+    const std::vector<unsigned char> ciphertext = ReferenceCFB8(key, plaintext, true);
+
+    // Decryption must match byte-wise CFB8 whatever the reads look like, in particular
+    // for chunks smaller than a block and chunks crossing the batch boundaries
+    CHECK(ReferenceCFB8(key, ciphertext, false) == plaintext);
+    CHECK(DecryptInChunks(key, ciphertext, { ciphertext.size() }) == plaintext);
+    CHECK(DecryptInChunks(key, ciphertext, { 1 }) == plaintext);
+    CHECK(DecryptInChunks(key, ciphertext, { DECRYPTION_BATCH_SIZE }) == plaintext);
+    CHECK(DecryptInChunks(key, ciphertext, { 15, 16, 17 }) == plaintext);
+    CHECK(DecryptInChunks(key, ciphertext, { DECRYPTION_BATCH_SIZE - 1, DECRYPTION_BATCH_SIZE + 1, 3, 2000 }) == plaintext);
+    for (int i = 0; i < 8; ++i)
+    {
+        std::vector<size_t> chunk_sizes(16);
+        for (size_t& s : chunk_sizes)
+        {
+            s = 1 + rng() % (3 * DECRYPTION_BATCH_SIZE);
+        }
+        CHECK(DecryptInChunks(key, ciphertext, chunk_sizes) == plaintext);
+    }
+
+    // Encryption is still done by OpenSSL CFB8, check it's not affected
+    MinecraftEncryptionDataProcessor processor(key);
+    std::vector<unsigned char> encrypted = plaintext;
+    processor.ProcessOutgoingData(encrypted.data(), 100);
+    processor.ProcessOutgoingData(encrypted.data() + 100, encrypted.size() - 100);
+    CHECK(encrypted == ciphertext);
+
+    return TestResult();
+}
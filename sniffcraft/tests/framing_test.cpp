@@ -0,0 +1,126 @@
+#include "sniffcraft/Framing.hpp"
+#include "TestUtils.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+void WriteVarInt(const int value, std::vector<unsigned char>& output)
+{
+    std::uint32_t remaining = static_cast<std::uint32_t>(value);
+    do
+    {
+        unsigned char byte = remaining & 0x7F;
+        remaining >>= 7;
+        if (remaining != 0)
+        {
+            byte |= 0x80;
+        }
+        output.push_back(byte);
+    } while (remaining != 0);
+}
+
+/// @brief Append a packet with a body of the given size to output
+void WritePacket(const size_t body_size, std::vector<unsigned char>& output)
+{
+    WriteVarInt(static_cast<int>(body_size), output);
+    for (size_t i = 0; i < body_size; ++i)
+    {
+        output.push_back(static_cast<unsigned char>(i));
+    }
+}
+
+void TestVarInt()
+{
+    for (const int value : { 0, 1, 127, 128, 255, 25565, 2097151, 2097152, INT_MAX, -1, INT_MIN })
+    {
+        std::vector<unsigned char> bytes;
+        WriteVarInt(value, bytes);
+        CHECK(VarIntSize(value) == bytes.size());
+
+        int decoded = 0;
+        CHECK(ReadVarIntNoThrow(bytes.data(), bytes.size(), decoded) == bytes.size());
+        CHECK(decoded == value);
+
+        // Any truncation is incomplete, and doesn't touch the output value
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            decoded = 42;
+            CHECK(ReadVarIntNoThrow(bytes.data(), i, decoded) == 0);
+            CHECK(decoded == 42);
+        }
+    }
+
+    // More than 5 bytes is never a valid VarInt
+    const unsigned char too_long[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+    int decoded = 0;
+    CHECK(ReadVarIntNoThrow(too_long, sizeof(too_long), decoded) == 0);
+}
+
+void TestFindCompleteFrames()
+{
+    std::vector<Frame> frames;
+    CHECK(FindCompleteFrames(nullptr, 0, frames) == 0);
+    CHECK(frames.empty());
+
+    std::vector<unsigned char> data;
+    const std::vector<size_t> body_sizes = { 1, 127, 128, 3, 20000, 5 };
+    for (const size_t size : body_sizes)
+    {
+        WritePacket(size, data);
+    }
+
+    CHECK(FindCompleteFrames(data.data(), data.size(), frames) == data.size());
+    CHECK(frames.size() == body_sizes.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < frames.size() && i < body_sizes.size(); ++i)
+    {
+        CHECK(frames[i].packet_size == body_sizes[i]);
+        CHECK(frames[i].length_size == VarIntSize(static_cast<int>(body_sizes[i])));
+        CHECK(data[offset + frames[i].length_size] == 0);
+        offset += frames[i].length_size + frames[i].packet_size;
+    }
+
+    // Cut anywhere, only the packets fully received are returned
+    for (size_t cut = 0; cut < data.size(); ++cut)
+    {
+        size_t expected_bytes = 0;
+        size_t expected_frames = 0;
+        for (const size_t size : body_sizes)
+        {
+            const size_t packet_bytes = VarIntSize(static_cast<int>(size)) + size;
+            if (expected_bytes + packet_bytes > cut)
+            {
+                break;
+            }
+            expected_bytes += packet_bytes;
+            expected_frames += 1;
+        }
+        if (FindCompleteFrames(data.data(), cut, frames) != expected_bytes || frames.size() != expected_frames)
+        {
+            CHECK(!"Wrong frames for a partial buffer");
+            break;
+        }
+    }
+
+    // An empty or negative packet length stops the scan, the data can't be framed after it
+    std::vector<unsigned char> invalid;
+    WritePacket(4, invalid);
+    WriteVarInt(0, invalid);
+    WritePacket(4, invalid);
+    CHECK(FindCompleteFrames(invalid.data(), invalid.size(), frames) == 5);
+    CHECK(frames.size() == 1);
+
+    invalid.clear();
+    WriteVarInt(-1, invalid);
+    CHECK(FindCompleteFrames(invalid.data(), invalid.size(), frames) == 0);
+    CHECK(frames.empty());
+}
+
+int main()
+{
+    TestVarInt();
+    TestFindCompleteFrames();
+
+    return TestResult();
+}
@@ -0,0 +1,171 @@
+#include "sniffcraft/conf.hpp"
+#include "sniffcraft/LoggingEngine.hpp"
+#include "TestUtils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/// @brief Session checking the records it receives are processed in order, and never after it's closed
+class TestSession : public LogSession
+{
+public:
+    TestSession(std::atomic<int>& errors_, std::atomic<int>& destroyed_) : errors(errors_), destroyed(destroyed_)
+    {
+        OpenSession();
+    }
+
+    virtual ~TestSession()
+    {
+        ReleaseSession();
+        // Everything pushed before the close has been processed, and the close only once
+        if (close_calls != 1 || consumed != expected)
+        {
+            errors += 1;
+        }
+        destroyed += 1;
+    }
+
+    void Log(const size_t index)
+    {
+        LogItem item{};
+        item.bandwidth_bytes = index;
+        PushRecord(std::move(item));
+    }
+
+    void LogMany(const size_t first, const size_t count)
+    {
+        std::vector<LogItem> items(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            items[i].bandwidth_bytes = first + i;
+        }
+        PushRecords(std::move(items));
+    }
+
+    void Stop()
+    {
+        CloseSession();
+    }
+
+    size_t expected = 0;
+    std::atomic<unsigned int> batch_ends = 0;
+    std::atomic<unsigned int> last_seen_generation = 0;
+
+protected:
+    virtual void Consume(LogItem& item) override
+    {
+        if (close_calls > 0 || item.bandwidth_bytes != consumed)
+        {
+            errors += 1;
+        }
+        consumed += 1;
+    }
+
+    virtual void OnBatchEnd() override
+    {
+        last_seen_generation = LoggingEngine::GetInstance().GetConfGeneration();
+        batch_ends += 1;
+    }
+
+    virtual void OnClose() override
+    {
+        close_calls += 1;
+    }
+
+private:
+    std::atomic<int>& errors;
+    std::atomic<int>& destroyed;
+    size_t consumed = 0;
+    int close_calls = 0;
+};
+
+void TestConcurrentSessions()
+{
+    constexpr int num_threads = 8;
+    constexpr int sessions_per_thread = 50;
+
+    // Destructors run on the engine reaper thread, they report their errors here
+    std::atomic<int> errors = 0;
+    std::atomic<int> destroyed = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back([&errors, &destroyed]()
+            {
+                for (int s = 0; s < sessions_per_thread; ++s)
+                {
+                    std::shared_ptr<TestSession> session = LoggingEngine::MakeSession<TestSession>(errors, destroyed);
+                    size_t index = 0;
+                    for (int k = 0; k < 100; ++k)
+                    {
+                        if (k % 3 == 0)
+                        {
+                            session->LogMany(index, 10);
+                            index += 10;
+                        }
+                        else
+                        {
+                            session->Log(index);
+                            index += 1;
+                        }
+                    }
+                    session->expected = index;
+                    // Half of the sessions are closed explicitly, the others only when dropped
+                    if (s % 2 == 1)
+                    {
+                        session->Stop();
+                    }
+                }
+            });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Wait for the reaper to destroy all the sessions
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (destroyed < num_threads * sessions_per_thread && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(destroyed == num_threads * sessions_per_thread);
+    CHECK(errors == 0);
+}
+
+void TestIdleSession()
+{
+    std::atomic<int> errors = 0;
+    std::atomic<int> destroyed = 0;
+    std::shared_ptr<TestSession> session = LoggingEngine::MakeSession<TestSession>(errors, destroyed);
+
+    // Without any record, the session is still checked regularly
+    std::this_thread::sleep_for(LOG_IDLE_CHECK_INTERVAL * 2 + std::chrono::milliseconds(500));
+    CHECK(session->batch_ends > 0);
+
+    // And sees the conf changes
+    const unsigned int generation = LoggingEngine::GetInstance().GetConfGeneration();
+    std::filesystem::last_write_time(Conf::conf_path, std::filesystem::file_time_type::clock::now() + std::chrono::hours(1));
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+    while (session->last_seen_generation == generation && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    CHECK(session->last_seen_generation != generation);
+}
+
+int main()
+{
+    // Don't touch any conf file next to the test binary
+    Conf::conf_path = "logging_engine_test_conf.json";
+    std::filesystem::remove(Conf::conf_path);
+
+    TestConcurrentSessions();
+    TestIdleSession();
+
+    return TestResult();
+}
@@ -0,0 +1,136 @@
+#include "sniffcraft/MPSCQueue.hpp"
+#include "TestUtils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct Item
+{
+    std::shared_ptr<int> payload;
+    size_t producer = 0;
+    size_t index = 0;
+};
+
+void TestFullQueue()
+{
+    MPSCQueue<Item> queue(4);
+    const std::shared_ptr<int> payload = std::make_shared<int>(0);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        Item item{ payload, 0, i };
+        CHECK(queue.TryPush(std::move(item)));
+    }
+
+    // A failed push must leave the item untouched
+    Item rejected{ payload, 0, 4 };
+    CHECK(!queue.TryPush(std::move(rejected)));
+    CHECK(rejected.payload == payload);
+
+    std::vector<Item> items;
+    CHECK(queue.PopAll(items) == 4);
+    CHECK(queue.Empty());
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        CHECK(items[i].index == i);
+    }
+
+    // Slots are reusable on the next lap
+    CHECK(queue.TryPush(std::move(rejected)));
+    CHECK(queue.PopAll(items) == 1);
+    CHECK(items.back().index == 4);
+}
+
+void TestMultipleProducers()
+{
+    constexpr size_t num_producers = 4;
+    constexpr size_t items_per_producer = 100000;
+
+    // Small queue so producers often find it full and have to wait for the consumer
+    MPSCQueue<Item> queue(64);
+    std::atomic<bool> running = true;
+    const std::shared_ptr<int> payload = std::make_shared<int>(0);
+
+    std::vector<size_t> next_index(num_producers, 0);
+    size_t received = 0;
+    bool in_order = true;
+    std::thread consumer([&]()
+        {
+            std::vector<Item> items;
+            while (true)
+            {
+                if (queue.PopAll(items) == 0)
+                {
+                    if (!running)
+                    {
+                        if (queue.Empty())
+                        {
+                            break;
+                        }
+                        continue;
+                    }
+                    queue.WaitForItems(running, std::chrono::milliseconds(100));
+                    continue;
+                }
+                for (const Item& item : items)
+                {
+                    // Items of one producer must arrive in order, without loss or duplicate
+                    if (item.producer >= num_producers || item.index != next_index[item.producer] || item.payload != payload)
+                    {
+                        in_order = false;
+                    }
+                    else
+                    {
+                        next_index[item.producer] += 1;
+                    }
+                    received += 1;
+                }
+                items.clear();
+            }
+        });
+
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < num_producers; ++p)
+    {
+        producers.emplace_back([&, p]()
+            {
+                for (size_t i = 0; i < items_per_producer; ++i)
+                {
+                    queue.Push({ payload, p, i });
+                    // Wake in batches, as the sessions do when pushing several records
+                    if (i % 16 == 15)
+                    {
+                        queue.WakeConsumer();
+                    }
+                }
+                queue.WakeConsumer();
+            });
+    }
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+
+    running = false;
+    queue.Interrupt();
+    consumer.join();
+
+    CHECK(in_order);
+    CHECK(received == num_producers * items_per_producer);
+    for (const size_t index : next_index)
+    {
+        CHECK(index == items_per_producer);
+    }
+    // All the items have been moved out of the queue and destroyed
+    CHECK(payload.use_count() == 1);
+}
+
+int main()
+{
+    TestFullQueue();
+    TestMultipleProducers();
+
+    return TestResult();
+}